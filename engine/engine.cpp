@@ -1,6 +1,7 @@
 #include "engine.h"
 
 #include "core/compute_pipeline.h"
+#include "core/cpu_profiler.h"
 #include "core/mesh_loader.h"
 #include "core/pipeline_builder.h"
 #include "imgui.h"
@@ -9,19 +10,38 @@
 #include "rendering/renderer.h"
 #include "utils/init.h"
 #include "utils/utils.h"
+#include <random>
 #include <slang-com-ptr.h>
 #include <vulkan/vulkan_core.h>
 
 namespace bisky {
 
-Engine::Engine() { initialize(); }
+Engine::Engine(EngineOptions options) : _options(std::move(options)) {
+  BISKY_PROFILE_THREAD("main");
+  core::CpuProfiler::get().setEnabled(!_options.cpuTrace.empty());
+  initialize();
+}
 
 Engine::~Engine() { cleanup(); }
 
 void Engine::initialize() {
-  _window = std::make_shared<core::Window>(800, 800, "Bisky Engine", this);
-  _device = std::make_shared<core::Device>(_window);
-  _renderer = std::make_shared<rendering::Renderer>(_window, _device);
+  rendering::RendererSettings settings = {};
+  settings.framesInFlight = _options.framesInFlight;
+  settings.presentMode = _options.presentMode;
+  settings.queuedFrames = _options.lowLatency ? 1 : 0;
+  if (_options.targetFrameTime > 0.0f) {
+    settings.resolution.enabled = true;
+    settings.resolution.targetFrameTime = _options.targetFrameTime;
+  }
+
+  if (_options.headless) {
+    _device = std::make_shared<core::Device>(nullptr);
+    _renderer = std::make_shared<rendering::Renderer>(_device, _options.extent, settings);
+  } else {
+    _window = std::make_shared<core::Window>(_options.extent.width, _options.extent.height, "Bisky Engine", this);
+    _device = std::make_shared<core::Device>(_window);
+    _renderer = std::make_shared<rendering::Renderer>(_window, _device, settings);
+  }
   // _computePipeline = std::make_shared<core::ComputePipeline>(_window, _device, _renderer);
 
   ComputeEffect gradient = {};
@@ -105,8 +125,9 @@ void Engine::initialize() {
   VkPipelineLayoutCreateInfo pipelineLayoutInfo = init::pipelineLayoutCreateInfo();
   pipelineLayoutInfo.pushConstantRangeCount = 1;
   pipelineLayoutInfo.pPushConstantRanges = &bufferRange;
-  pipelineLayoutInfo.setLayoutCount = 1;
-  pipelineLayoutInfo.pSetLayouts = &_renderer->singleImageLayout();
+  VkDescriptorSetLayout meshSetLayouts[] = {_renderer->bindlessLayout(), _renderer->sceneDataLayout()};
+  pipelineLayoutInfo.setLayoutCount = 2;
+  pipelineLayoutInfo.pSetLayouts = meshSetLayouts;
 
   VK_CHECK(vkCreatePipelineLayout(_device->device(), &pipelineLayoutInfo, nullptr, &_meshPipelineLayout));
 
@@ -122,7 +143,7 @@ void Engine::initialize() {
                       // .enableBlendingAdditive()
                       .enableDepthTest(true, VK_COMPARE_OP_GREATER_OR_EQUAL)
                       .setColorAttachmentFormat(_renderer->drawImage().format)
-                      .setDepthFormat(_renderer->depthImage().format)
+                      .setDepthFormat(_renderer->depthFormat())
                       .build(_device->device());
 
   // load our meshes
@@ -130,6 +151,32 @@ void Engine::initialize() {
       core::MeshLoader::loadGltfMeshes(_device, _renderer->immediateSubmit(), "../resources/models/basicmesh.glb")
           .value();
 
+  // default material using the mesh pipeline, its set falls back to the renderer's checkerboard
+  _defaultMaterial = std::make_shared<MaterialInstance>();
+  _defaultMaterial->pipeline = std::make_shared<MaterialPipeline>(MaterialPipeline{_meshPipeline, _meshPipelineLayout});
+  _defaultMaterial->textureIndex = _renderer->errorImage().textureIndex;
+  _defaultMaterial->samplerIndex = _renderer->nearestSampler();
+  _defaultMaterial->passType = MaterialPass::COLOR;
+
+  for (auto &mesh : _testMeshes) {
+    _meshNodes.push_back(std::make_shared<rendering::MeshNode>(mesh, _defaultMaterial));
+  }
+
+  // gpu driven path over every loaded surface
+  _indirectDrawer = std::make_shared<rendering::IndirectDrawer>(
+      _device, _renderer->immediateSubmit(), _renderer->descriptorCache(), _renderer->framesInFlight());
+  _indirectDrawer->buildPipelines(newSession, _renderer->drawImage().format, _renderer->depthFormat());
+  _indirectDrawer->upload(_testMeshes);
+  _renderer->setIndirectDrawer(_indirectDrawer);
+
+  _depthPyramid = std::make_shared<rendering::DepthPyramid>(_device, _renderer->descriptorCache());
+  _depthPyramid->buildPipeline(newSession);
+  _renderer->setDepthPyramid(_depthPyramid);
+
+  _lightCuller = std::make_shared<rendering::LightCuller>(_device, _renderer->framesInFlight());
+  _lightCuller->buildPipeline(newSession);
+  _renderer->setLightCuller(_lightCuller);
+
   // destroy the shader modules
   vkDestroyShaderModule(_device->device(), triangleVertShader, nullptr);
   vkDestroyShaderModule(_device->device(), triangleFragShader, nullptr);
@@ -159,10 +206,18 @@ void Engine::initializeSlang() {
 }
 
 void Engine::cleanup() {
+  if (!_options.cpuTrace.empty()) {
+    core::CpuProfiler::get().writeChromeTrace(_options.cpuTrace);
+  }
+
   for (auto &asset : _testMeshes) {
     asset->meshBuffers.cleanup(_device->allocator());
   }
 
+  _indirectDrawer->cleanup();
+  _depthPyramid->cleanup();
+  _lightCuller->cleanup();
+
   vkDestroyPipelineLayout(_device->device(), _meshPipelineLayout, nullptr);
   vkDestroyPipeline(_device->device(), _meshPipeline, nullptr);
 
@@ -173,11 +228,35 @@ void Engine::cleanup() {
 
   _renderer->cleanup();
   _device->cleanup();
-  _window->cleanup();
+
+  if (_window) {
+    _window->cleanup();
+  }
 }
 
 void Engine::run() {
-  while (!_window->shouldClose()) {
+  BISKY_PROFILE_ZONE("Engine::run");
+
+  if (_options.headless) {
+    for (uint32_t frame = 0; frame < _options.frames; frame++) {
+      BISKY_PROFILE_FRAME();
+      _renderer->pace();
+      update();
+      render();
+    }
+
+    if (!_options.output.empty()) {
+      _renderer->writeFrame(_options.output);
+    }
+    if (!_options.gpuTimings.empty()) {
+      _renderer->gpuProfiler().writeJson(_options.gpuTimings);
+    }
+  }
+
+  while (_window && !_window->shouldClose()) {
+    BISKY_PROFILE_FRAME();
+    // pace before polling so the input reaches the screen as soon as the queue allows
+    _renderer->pace();
     input();
     update();
     render();
@@ -188,9 +267,34 @@ void Engine::run() {
 
 void Engine::input() { glfwPollEvents(); }
 
-void Engine::update() {}
+void Engine::update() {
+  _renderContext.objects.clear();
 
-void Engine::render() {
+  for (auto &node : _meshNodes) {
+    node->draw(glm::mat4(1.0f), _renderContext);
+  }
+}
+
+// small lights of random colors around the test meshes, every fourth one a spot light pointing down
+void Engine::scatterLights(uint32_t count) {
+  std::mt19937 random(count);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::uniform_real_distribution<float> spread(-4.0f, 4.0f);
+
+  Vector<GPULight> &lights = _lightCuller->lights();
+  lights.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    GPULight &light = lights[i];
+    light.position = glm::vec3(spread(random), spread(random) * 0.75f, spread(random) * 0.5f - 1.0f);
+    light.radius = 0.5f + unit(random);
+    light.color = glm::vec3(unit(random), unit(random), unit(random));
+    light.intensity = 0.5f;
+    light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    light.spotCosine = i % 4 == 3 ? std::cos(glm::radians(30.0f)) : -1.0f;
+  }
+}
+
+void Engine::renderDebugUi() {
   // imgui new frame
   ImGui_ImplVulkan_NewFrame();
   ImGui_ImplGlfw_NewFrame();
@@ -201,7 +305,44 @@ void Engine::render() {
 
   ComputeEffect &selected = _backgroundEffects[_currentBackgroundEffect];
 
-  ImGui::SliderFloat("Render Scale", &_renderer->renderScale(), 0.3f, 1.0f);
+  rendering::ResolutionScaler::Settings &resolution = _renderer->resolutionScaler().settings();
+  ImGui::Checkbox("Dynamic Resolution", &resolution.enabled);
+  if (resolution.enabled) {
+    ImGui::SliderFloat("Target GPU Time", &resolution.targetFrameTime, 2.0f, 50.0f, "%.1f ms");
+    ImGui::DragFloatRange2("Scale Bounds", &resolution.minScale, &resolution.maxScale, 0.01f, 0.3f, 1.0f);
+    ImGui::Text("Render Scale: %.2f, smoothed GPU time %.2f ms", _renderer->renderScale(),
+                _renderer->resolutionScaler().smoothedFrameTime());
+  } else {
+    ImGui::SliderFloat("Render Scale", &_renderer->renderScale(), 0.3f, 1.0f);
+  }
+  ImGui::Checkbox("GPU Driven", &_renderer->gpuDriven());
+  if (!_renderer->gpuDriven()) {
+    const rendering::DrawList::Stats &stats = _renderer->drawStats();
+    ImGui::Text("Visible: %u / %zu", _renderer->visibleObjects(), _renderContext.objects.size());
+    ImGui::Text("Draws: %u, instances: %u", stats.draws, stats.instances);
+    ImGui::Text("Pipeline binds: %u, set binds: %u, index binds: %u", stats.pipelineBinds, stats.descriptorBinds,
+                stats.indexBufferBinds);
+    rendering::LodSelector &lods = _renderer->lodSelector();
+    ImGui::Text("Triangles: %u / %u", lods.triangles(), lods.fullTriangles());
+  } else {
+    ImGui::Checkbox("Compact Vertices", &_indirectDrawer->compactVertices());
+    ImGui::Checkbox("Cluster Culling", &_indirectDrawer->clusterCulling());
+    if (!_indirectDrawer->clusterCulling()) {
+      ImGui::Checkbox("Occlusion Culling", &_indirectDrawer->occlusionCulling());
+    }
+    if (_indirectDrawer->clusterCulling()) {
+      ImGui::Text("Meshlets: %u", _indirectDrawer->meshletCount());
+    }
+    const core::DescriptorCache &descriptors = *_renderer->descriptorCache();
+    if (descriptors.descriptorBuffers()) {
+      ImGui::Text("Descriptors: descriptor buffers");
+    } else {
+      ImGui::Text("Cached sets: %u, hits: %llu, misses: %llu", descriptors.size(),
+                  static_cast<unsigned long long>(descriptors.hits()),
+                  static_cast<unsigned long long>(descriptors.misses()));
+    }
+  }
+  ImGui::SliderFloat("LOD Threshold", &_renderer->lodSelector().threshold(), 0.25f, 8.0f, "%.2f px");
   ImGui::Text("Selected Effect: %s", selected.name);
   ImGui::SliderInt("Effect Index", &_currentBackgroundEffect, 0, 1);
   ImGui::InputFloat4("data1", (float *)&selected.data.data1);
@@ -209,9 +350,73 @@ void Engine::render() {
   ImGui::InputFloat4("data3", (float *)&selected.data.data3);
   ImGui::InputFloat4("data4", (float *)&selected.data.data4);
 
+  if (ImGui::CollapsingHeader("Lights")) {
+    int lightCount = static_cast<int>(_lightCuller->lights().size());
+    if (ImGui::SliderInt("Count", &lightCount, 0, rendering::LightCuller::MAX_LIGHTS)) {
+      scatterLights(lightCount);
+    }
+  }
+
+  if (ImGui::CollapsingHeader("Frame Pacing")) {
+    static constexpr VkPresentModeKHR presentModes[] = {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR,
+                                                        VK_PRESENT_MODE_IMMEDIATE_KHR};
+    static constexpr const char *presentModeNames[] = {"FIFO", "Mailbox", "Immediate"};
+
+    int presentMode = 0;
+    for (int i = 0; i < 3; i++) {
+      if (presentModes[i] == _renderer->presentMode()) {
+        presentMode = i;
+      }
+    }
+    if (ImGui::Combo("Present Mode", &presentMode, presentModeNames, 3)) {
+      _renderer->setPresentMode(presentModes[presentMode]);
+    }
+
+    rendering::FramePacer &pacer = _renderer->framePacer();
+    int queuedFrames = pacer.queuedFrames();
+    if (ImGui::SliderInt("Queued Frames", &queuedFrames, 1, _renderer->framesInFlight())) {
+      pacer.setQueuedFrames(queuedFrames);
+    }
+    ImGui::Text("Frames in flight: %u", _renderer->framesInFlight());
+    ImGui::Text("Latency: %.2f ms, avg %.2f ms", pacer.latency(), pacer.averageLatency());
+  }
+
+  rendering::GpuProfiler &profiler = _renderer->gpuProfiler();
+  if (ImGui::CollapsingHeader("GPU Timings")) {
+    bool enabled = profiler.enabled();
+    if (ImGui::Checkbox("Enabled", &enabled)) {
+      profiler.setEnabled(enabled);
+    }
+    for (const rendering::GpuProfiler::Timing &timing : profiler.timings()) {
+      ImGui::Text("%-12s %7.3f ms  avg %7.3f  max %7.3f", timing.name.c_str(), timing.last(), timing.average(),
+                  timing.max());
+    }
+    if (ImGui::Button("Export JSON")) {
+      profiler.writeJson("gpu_timings.json");
+    }
+  }
+
+  if (ImGui::CollapsingHeader("CPU Trace")) {
+    bool enabled = core::CpuProfiler::get().enabled();
+    if (ImGui::Checkbox("Record", &enabled)) {
+      core::CpuProfiler::get().setEnabled(enabled);
+    }
+    if (ImGui::Button("Export Chrome Trace")) {
+      core::CpuProfiler::get().writeChromeTrace("cpu_trace.json");
+    }
+  }
+
   ImGui::End();
 
   ImGui::Render();
+}
+
+void Engine::render() {
+  BISKY_PROFILE_ZONE("Engine::render");
+
+  if (!_options.headless) {
+    renderDebugUi();
+  }
 
   // reset fences and wait for next fence
   _renderer->waitForFence();
@@ -219,6 +424,7 @@ void Engine::render() {
   // reset our descriptor allocators
   _renderer->getCurrentFrame().deletionQueue.flush();
   _renderer->getCurrentFrame().frameDescriptors.clearPools(_device->device());
+  _renderer->getCurrentFrame().uniformRing.reset();
 
   // try to acquire the next image
   uint32_t imageIndex;
@@ -232,8 +438,7 @@ void Engine::render() {
   VkCommandBuffer commandBuffer = _renderer->beginRenderPass();
 
   // draw the image to the swapchain
-  _renderer->draw(commandBuffer, _backgroundEffects[_currentBackgroundEffect], _meshPipelineLayout, _meshPipeline,
-                  _testMeshes, imageIndex);
+  _renderer->draw(commandBuffer, _backgroundEffects[_currentBackgroundEffect], _renderContext, imageIndex);
 
   // end command buffer and render pass
   _renderer->endRenderPass(commandBuffer);
@@ -45,9 +45,31 @@ struct GLTFMetallicObject {
                                  core::DescriptorAllocatorGrowable &descriptorAllocator);
 };
 
+struct EngineOptions {
+  // renders offscreen without a window, for batch jobs and machines without a display
+  bool headless = false;
+  VkExtent2D extent = {800, 800};
+
+  // headless runs render this many frames, then write the last one to output and the gpu timings, if set
+  uint32_t frames = 1;
+  std::string output;
+  std::string gpuTimings;
+
+  // records cpu zones from startup and writes them as a chrome trace on shutdown
+  std::string cpuTrace;
+
+  uint32_t framesInFlight = 2;
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+  // waits for the previous frame before sampling input, instead of queueing every frame in flight
+  bool lowLatency = false;
+
+  // scales the resolution to hold this gpu frame time in milliseconds, 0 keeps the scale fixed
+  float targetFrameTime = 0.0f;
+};
+
 class Engine : public ICallbacks {
 public:
-  Engine();
+  Engine(EngineOptions options = {});
   ~Engine();
 
   void run();
@@ -56,6 +78,8 @@ private:
   void input();
   void update();
   void render();
+  void renderDebugUi();
+  void scatterLights(uint32_t count);
 
   void initialize();
   void initializeSlang();
@@ -66,9 +90,13 @@ private:
   virtual void onClick(int button, int action, int mods) override;
   virtual void onMouseMove(double xpos, double ypos) override;
 
+  EngineOptions _options;
   Pointer<core::Window> _window;
   Pointer<core::Device> _device;
   Pointer<rendering::Renderer> _renderer;
+  Pointer<rendering::IndirectDrawer> _indirectDrawer;
+  Pointer<rendering::DepthPyramid> _depthPyramid;
+  Pointer<rendering::LightCuller> _lightCuller;
 
   Vector<ComputeEffect> _backgroundEffects;
   int _currentBackgroundEffect = 0;
@@ -77,6 +105,9 @@ private:
   VkPipeline _meshPipeline;
 
   Vector<Pointer<MeshAsset>> _testMeshes;
+  Pointer<MaterialInstance> _defaultMaterial;
+  Vector<Pointer<rendering::MeshNode>> _meshNodes;
+  rendering::RenderContext _renderContext;
 
   Slang::ComPtr<slang::IGlobalSession> _globalSession;
   Slang::ComPtr<slang::ISession> _session;
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "pch.h"
+
+#include "core/deletion_queue.h"
+
+namespace bisky {
+namespace core {
+
+/**
+ * A single global descriptor set holding every sampled image and sampler in two partially bound arrays, so shaders
+ * select textures by index and the set is bound once per pipeline instead of once per material. Slots are written
+ * when a resource is added, slots no pending command buffer uses may be rewritten while the set is still bound.
+ *
+ * a removed texture's slot is only handed out again once the frame it was removed in has finished on the GPU.
+ */
+class BindlessDescriptors {
+public:
+  static constexpr uint32_t TEXTURE_BINDING = 0;
+  static constexpr uint32_t SAMPLER_BINDING = 1;
+  static constexpr uint32_t MAX_TEXTURES = 4096;
+  static constexpr uint32_t MAX_SAMPLERS = 32;
+
+  void init(VkDevice device);
+  void cleanup(VkDevice device);
+
+  // the view is sampled in SHADER_READ_ONLY_OPTIMAL
+  uint32_t addTexture(VkDevice device, VkImageView view);
+  void removeTexture(uint32_t index, DeletionQueue &retired);
+  uint32_t addSampler(VkDevice device, VkSampler sampler);
+
+  VkDescriptorSetLayout layout() { return _layout; }
+  VkDescriptorSet set() { return _set; }
+  uint32_t textureCount() { return _textureCount - static_cast<uint32_t>(_freeTextures.size()); }
+
+private:
+  VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
+  VkDescriptorPool _pool = VK_NULL_HANDLE;
+  VkDescriptorSet _set = VK_NULL_HANDLE;
+
+  uint32_t _textureCount = 0;
+  uint32_t _samplerCount = 0;
+  Vector<uint32_t> _freeTextures;
+};
+
+} // namespace core
+} // namespace bisky
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "pch.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+namespace bisky {
+namespace core {
+
+/**
+ * Records zones, counters and frame markers into per-thread ring buffers and writes them as Chrome trace events,
+ * viewable in chrome://tracing or Perfetto. Every thread only ever writes its own buffer, so recording takes no locks,
+ * a thread's buffer is registered once on its first event. While disabled an instrumentation point costs one relaxed
+ * atomic load, without BISKY_PROFILER the macros compile to nothing.
+ *
+ * names must be string literals or otherwise outlive the profiler, they are stored by pointer.
+ */
+class CpuProfiler {
+public:
+  static constexpr uint32_t EVENTS_PER_THREAD = 1 << 16;
+
+  enum class EventType : uint8_t {
+    ZONE,
+    COUNTER,
+    FRAME,
+  };
+
+  struct Event {
+    const char *name;
+    uint64_t start;
+    union {
+      uint64_t duration;
+      double value;
+    };
+    EventType type;
+  };
+
+  class Scope {
+  public:
+    explicit Scope(const char *name) : _name(name), _start(CpuProfiler::get().enabled() ? now() : 0) {}
+    ~Scope() {
+      if (_start) {
+        CpuProfiler::get().zone(_name, _start, now());
+      }
+    }
+
+  private:
+    const char *_name;
+    uint64_t _start;
+  };
+
+  static CpuProfiler &get();
+
+  // nanoseconds on the steady clock
+  static uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+  void setEnabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+
+  void zone(const char *name, uint64_t start, uint64_t end);
+  void counter(const char *name, double value);
+  void frame();
+  void setThreadName(const char *name);
+
+  // other threads should be idle, events recorded while writing may be torn
+  void writeChromeTrace(const std::string &path);
+
+private:
+  struct ThreadBuffer {
+    uint32_t id;
+    const char *name = nullptr;
+    std::atomic<uint64_t> head = 0;
+    Vector<Event> events = Vector<Event>(EVENTS_PER_THREAD);
+  };
+
+  CpuProfiler() = default;
+
+  ThreadBuffer &threadBuffer();
+  void push(const Event &event);
+
+  std::atomic<bool> _enabled = false;
+
+  // only locked when a thread records its first event and when writing the trace
+  std::mutex _threadsMutex;
+  Vector<std::unique_ptr<ThreadBuffer>> _threads;
+};
+
+} // namespace core
+} // namespace bisky
+
+#ifdef BISKY_PROFILER
+#define BISKY_PROFILE_CONCAT_(a, b) a##b
+#define BISKY_PROFILE_CONCAT(a, b) BISKY_PROFILE_CONCAT_(a, b)
+#define BISKY_PROFILE_ZONE(name) ::bisky::core::CpuProfiler::Scope BISKY_PROFILE_CONCAT(_profileZone, __LINE__)(name)
+#define BISKY_PROFILE_COUNTER(name, value)                                                                             \
+  do {                                                                                                                 \
+    if (::bisky::core::CpuProfiler::get().enabled()) {                                                                 \
+      ::bisky::core::CpuProfiler::get().counter(name, static_cast<double>(value));                                     \
+    }                                                                                                                  \
+  } while (0)
+#define BISKY_PROFILE_FRAME()                                                                                          \
+  do {                                                                                                                 \
+    if (::bisky::core::CpuProfiler::get().enabled()) {                                                                 \
+      ::bisky::core::CpuProfiler::get().frame();                                                                       \
+    }                                                                                                                  \
+  } while (0)
+#define BISKY_PROFILE_THREAD(name) ::bisky::core::CpuProfiler::get().setThreadName(name)
+#else
+#define BISKY_PROFILE_ZONE(name)
+#define BISKY_PROFILE_COUNTER(name, value)
+#define BISKY_PROFILE_FRAME()
+#define BISKY_PROFILE_THREAD(name)
+#endif
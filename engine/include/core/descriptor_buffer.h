@@ -0,0 +1,51 @@
+#pragma once
+
+#include "gpu/gpu_ring_buffer.h"
+#include "pch.h"
+#include <unordered_map>
+
+namespace bisky {
+namespace core {
+
+class Device;
+
+/**
+ * VK_EXT_descriptor_buffer counterpart of DescriptorAllocatorGrowable. Sets are bump allocated in a persistently mapped
+ * ring and written by copying descriptors straight into it, binding one only sets an offset. The ring is reclaimed as
+ * a whole with reset once the GPU is done with it, like clearPools.
+ *
+ * layouts have to be created with DESCRIPTOR_BUFFER_BIT and hold resource descriptors only, samplers would need a
+ * separate sampler descriptor buffer.
+ */
+class DescriptorBuffer {
+public:
+  void init(Pointer<Device> device, size_t size);
+  void cleanup();
+  void reset() { _ring.reset(); }
+
+  GPURingBuffer::Allocation allocate(VkDescriptorSetLayout layout);
+  // where binding starts in sets of layout
+  VkDeviceSize bindingOffset(VkDescriptorSetLayout layout, uint32_t binding);
+
+  // binds the ring and points set at offset, binding descriptor sets afterwards unbinds it again
+  void bind(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t set,
+            uint32_t offset);
+
+  Device &device() { return *_device; }
+
+private:
+  struct LayoutInfo {
+    VkDeviceSize size;
+    Vector<VkDeviceSize> bindingOffsets;
+  };
+
+  LayoutInfo &layoutInfo(VkDescriptorSetLayout layout);
+
+  Pointer<Device> _device;
+  GPURingBuffer _ring;
+  // layout sizes and offsets are queried once per layout
+  std::unordered_map<VkDescriptorSetLayout, LayoutInfo> _layouts;
+};
+
+} // namespace core
+} // namespace bisky
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "core/deletion_queue.h"
+#include "core/descriptor_allocator_growable.h"
+#include "core/descriptor_buffer.h"
+#include "core/descriptor_writer.h"
+#include "pch.h"
+#include <unordered_map>
+
+namespace bisky {
+namespace core {
+
+/**
+ * Long lived descriptor sets looked up by their contents. A DescriptorWriter describing the same layout, resources
+ * and bindings as an earlier one gets the set that was written back then, so sets that are rebuilt identically every
+ * frame are allocated and written once.
+ *
+ * cached sets are never written again, resources have to be evicted before they are destroyed. Evicted sets are
+ * recycled for later requests of the same layout once the GPU is done with them.
+ *
+ * with VK_EXT_descriptor_buffer bind skips the cache and the pools, it copies the descriptors into the frame's
+ * descriptor buffer every time, which costs about as much as a lookup. Layouts and pipelines bound through it are
+ * created with layoutFlags and pipelineFlags.
+ */
+class DescriptorCache {
+public:
+  static constexpr size_t DESCRIPTOR_BUFFER_SIZE = 64 * 1024;
+
+  void init(Pointer<Device> device, uint32_t frameCount, uint32_t initialSets,
+            std::span<DescriptorAllocatorGrowable::PoolSizeRatio> poolRatios);
+  void cleanup();
+
+  // the frame's fence has to have signaled, its descriptor buffer is reused
+  void beginFrame(uint32_t frame);
+
+  bool descriptorBuffers() const { return !_buffers.empty(); }
+  VkDescriptorSetLayoutCreateFlags layoutFlags() const {
+    return descriptorBuffers() ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+  }
+  VkPipelineCreateFlags pipelineFlags() const {
+    return descriptorBuffers() ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+  }
+
+  // writes the set with writer on a miss only, pool backed layouts only
+  VkDescriptorSet get(VkDevice device, VkDescriptorSetLayout layout, DescriptorWriter &writer);
+  // binds the set writer describes with whichever backend is active
+  void bind(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t set,
+            VkDescriptorSetLayout layout, DescriptorWriter &writer);
+
+  // drops every set referencing the image view, sampler or buffer, they are recycled when retired is flushed or
+  // right away without one
+  void evict(uint64_t handle, DeletionQueue *retired = nullptr);
+
+  uint32_t size() const { return static_cast<uint32_t>(_sets.size()); }
+  uint64_t hits() const { return _hits; }
+  uint64_t misses() const { return _misses; }
+
+private:
+  // matches DescriptorWriter::appendKey
+  static constexpr size_t WORDS_PER_WRITE = 5;
+
+  struct KeyHash {
+    size_t operator()(const Vector<uint64_t> &key) const;
+  };
+
+  static bool references(const Vector<uint64_t> &key, uint64_t handle);
+
+  Pointer<Device> _device;
+  DescriptorAllocatorGrowable _allocator;
+  // one per frame in flight when descriptor buffers are supported
+  Vector<DescriptorBuffer> _buffers;
+  uint32_t _frame = 0;
+
+  std::unordered_map<Vector<uint64_t>, VkDescriptorSet, KeyHash> _sets;
+  std::unordered_map<VkDescriptorSetLayout, Vector<VkDescriptorSet>> _freeSets;
+  // reused between lookups so hits do not allocate
+  Vector<uint64_t> _key;
+
+  uint64_t _hits = 0;
+  uint64_t _misses = 0;
+};
+
+} // namespace core
+} // namespace bisky
@@ -1,21 +1,32 @@
 #pragma once
 
+#include "gpu/gpu_buffer.h"
 #include "pch.h"
 #include <deque>
 
 namespace bisky {
 namespace core {
 
+class DescriptorBuffer;
+
 struct DescriptorWriter {
   std::deque<VkDescriptorImageInfo> imageInfos;
   std::deque<VkDescriptorBufferInfo> bufferInfos;
   Vector<VkWriteDescriptorSet> writes;
 
-  void writeImage(int binding, VkImageView image, VkSampler sampler, VkImageLayout layout, VkDescriptorType type);
+  void writeImage(int binding, VkImageView image, VkSampler sampler, VkImageLayout layout, VkDescriptorType type,
+                  uint32_t arrayElement = 0);
   void writeBuffer(int binding, VkBuffer buffer, size_t size, size_t offset, VkDescriptorType type);
+  // the whole buffer with its real size, which descriptor buffers need in place of VK_WHOLE_SIZE
+  void writeBuffer(int binding, const GPUBuffer &buffer, VkDescriptorType type);
 
   void clear();
   void updateSet(VkDevice device, VkDescriptorSet set);
+  // the descriptor buffer path, set points at an allocation of layout in buffer. Buffers need explicit ranges and
+  // SHADER_DEVICE_ADDRESS usage
+  void updateBuffer(DescriptorBuffer &buffer, VkDescriptorSetLayout layout, void *set);
+  // the layout and every written descriptor, sets written from equal keys are identical
+  void appendKey(VkDescriptorSetLayout layout, Vector<uint64_t> &key) const;
 };
 
 } // namespace core
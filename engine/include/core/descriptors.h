@@ -9,7 +9,7 @@ struct DescriptorLayoutBuilder {
   std::vector<VkDescriptorSetLayoutBinding> bindings;
   void clear();
 
-  DescriptorLayoutBuilder &add(uint32_t binding, VkDescriptorType type);
+  DescriptorLayoutBuilder &add(uint32_t binding, VkDescriptorType type, uint32_t count = 1);
   VkDescriptorSetLayout build(VkDevice device, VkShaderStageFlags shaderStages, void *pNext = nullptr,
                               VkDescriptorSetLayoutCreateFlags flags = 0);
 };
@@ -8,9 +8,19 @@ namespace core {
 
 class Window;
 
+// VK_EXT_descriptor_buffer entry points, only loaded when the extension is enabled
+struct DescriptorBufferFunctions {
+  PFN_vkGetDescriptorSetLayoutSizeEXT getLayoutSize = nullptr;
+  PFN_vkGetDescriptorSetLayoutBindingOffsetEXT getBindingOffset = nullptr;
+  PFN_vkGetDescriptorEXT getDescriptor = nullptr;
+  PFN_vkCmdBindDescriptorBuffersEXT bindBuffers = nullptr;
+  PFN_vkCmdSetDescriptorBufferOffsetsEXT setOffsets = nullptr;
+};
+
 class Device {
 
 public:
+  // without a window the device is headless, it has no surface and renderers on it draw offscreen
   Device(Pointer<Window> window);
   ~Device();
 
@@ -27,8 +37,21 @@ public:
   QueueFamilyIndices indices() { return _indices; }
   uint32_t queueFamily() { return _indices.queueFamily.value(); }
   const VkQueue &queue() { return _queue; }
+  bool hasAsyncCompute() { return _indices.computeFamily.has_value(); }
+  uint32_t computeQueueFamily() { return _indices.computeFamily.value_or(queueFamily()); }
+  const VkQueue &computeQueue() { return _computeQueue; }
+  bool hasTransferQueue() { return _indices.transferFamily.has_value(); }
+  uint32_t transferQueueFamily() { return _indices.transferFamily.value_or(queueFamily()); }
+  const VkQueue &transferQueue() { return _transferQueue; }
   VkSurfaceKHR surface() { return _surface; }
+  bool headless() { return _window == nullptr; }
   VmaAllocator allocator() { return _allocator; }
+  const VkPhysicalDeviceProperties &properties() { return _properties; }
+  bool hasDescriptorBuffer() { return _descriptorBuffer; }
+  const VkPhysicalDeviceDescriptorBufferPropertiesEXT &descriptorBufferProperties() {
+    return _descriptorBufferProperties;
+  }
+  const DescriptorBufferFunctions &descriptorBufferFunctions() { return _descriptorBufferFunctions; }
 
   void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryAllocateFlags properties, VkBuffer &buffer,
                     VmaAllocation &allocation);
@@ -54,18 +77,28 @@ private:
   QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
   bool isDeviceSuitable(VkPhysicalDevice device);
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+  bool supportsExtension(VkPhysicalDevice device, const char *name);
+  void loadDescriptorBuffer();
+  Vector<const char *> requiredExtensions();
 
   Pointer<Window> _window;
 
   VkInstance _instance;
   VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties _properties;
   VkDevice _device;
-  VkSurfaceKHR _surface;
+  VkSurfaceKHR _surface = VK_NULL_HANDLE;
   VkDebugUtilsMessengerEXT _debugMessenger;
   QueueFamilyIndices _indices;
   VkQueue _queue;
+  VkQueue _computeQueue;
+  VkQueue _transferQueue;
   VmaAllocator _allocator;
 
+  bool _descriptorBuffer = false;
+  VkPhysicalDeviceDescriptorBufferPropertiesEXT _descriptorBufferProperties = {};
+  DescriptorBufferFunctions _descriptorBufferFunctions;
+
   DeletionQueue _deletionQueue;
 };
 
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "pch.h"
+#include <unordered_map>
+
+namespace bisky {
+namespace core {
+
+struct ImageState {
+  VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+  VkAccessFlags2 access = VK_ACCESS_2_NONE;
+};
+
+/**
+ * Remembers the layout, stages and accesses every tracked image was last used with and turns each new use into the
+ * narrowest barrier that orders it after the previous one. Barriers are queued and recorded together by flush() as a
+ * single vkCmdPipelineBarrier2.
+ */
+class ImageStateTracker {
+public:
+  static constexpr VkAccessFlags2 WRITE_ACCESS =
+      VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+      VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+      VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+  // reads in the same layout can run concurrently, everything else needs a barrier
+  static bool needsBarrier(const ImageState &current, const ImageState &next) {
+    return current.layout != next.layout || (current.access & WRITE_ACCESS) || (next.access & WRITE_ACCESS);
+  }
+
+  static VkImageMemoryBarrier2 makeBarrier(VkImage image, VkImageAspectFlags aspect, const ImageState &src,
+                                           const ImageState &dst);
+
+  void track(VkImage image, VkImageAspectFlags aspect, ImageState state = {});
+  void untrack(VkImage image);
+
+  void use(VkImage image, const ImageState &next);
+  void flush(VkCommandBuffer cmd);
+
+  const ImageState &state(VkImage image) { return _images.at(image).state; }
+
+private:
+  struct TrackedImage {
+    VkImageAspectFlags aspect;
+    ImageState state;
+    int32_t pendingBarrier = -1;
+  };
+
+  std::unordered_map<VkImage, TrackedImage> _images;
+  Vector<VkImageMemoryBarrier2> _barriers;
+  Vector<VkImage> _pendingImages;
+};
+
+} // namespace core
+} // namespace bisky
@@ -1,29 +1,82 @@
 #pragma once
 
 #include "core/deletion_queue.h"
+#include "core/image_state_tracker.h"
 #include "pch.h"
+#include <deque>
+#include <span>
 
 namespace bisky {
 namespace core {
 
 class Device;
 
+/**
+ * Records and submits one off upload commands. Uploads run on the device's transfer queue without waiting, they hand
+ * the written buffers and images over to the graphics queue family in the next frame's submit, which records the
+ * acquire barriers ahead of its commands and waits for the copies on a timeline semaphore.
+ *
+ * without a transfer queue uploads run on the graphics queue and block until the copies have completed.
+ */
 class ImmediateSubmit {
 public:
+  // the stages and accesses the graphics queue uses an uploaded resource with
+  struct BufferUpload {
+    VkBuffer buffer;
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+  };
+
+  struct ImageUpload {
+    VkImage image;
+    VkImageAspectFlags aspect;
+    ImageState state;
+  };
+
   ImmediateSubmit(Pointer<Device> device);
   ~ImmediateSubmit();
 
   void cleanup();
-  void submit(std::function<void(VkCommandBuffer cmd)> &&function);
+
+  // images are transitioned to TRANSFER_DST_OPTIMAL before the copies are recorded. release frees the staging
+  // resources once the copies have completed
+  void upload(std::function<void(VkCommandBuffer cmd)> &&function, std::span<const BufferUpload> buffers,
+              std::span<const ImageUpload> images = {}, std::function<void()> &&release = nullptr);
+
+  // runs release of every upload whose copies have completed, called once per frame
+  void collect();
+  // records the acquires of the uploads since the last call into a command buffer that has to be submitted to the
+  // graphics queue ahead of any use of them, waiting on wait. The command buffer is recycled when retired is flushed
+  bool acquire(DeletionQueue &retired, VkCommandBufferSubmitInfo &cmdInfo, VkSemaphoreSubmitInfo &wait);
 
 private:
+  struct PendingUpload {
+    uint64_t value;
+    VkCommandBuffer commandBuffer;
+    std::function<void()> release;
+  };
+
   void initialize();
+  VkCommandBuffer takeCommandBuffer(Vector<VkCommandBuffer> &freeCommandBuffers, VkCommandPool pool);
 
   Pointer<Device> _device;
 
   VkFence _fence;
   VkCommandBuffer _commandBuffer;
   VkCommandPool _commandPool;
+
+  // only created when the device has a dedicated transfer queue, the timeline counts the transfer submits
+  VkCommandPool _transferCommandPool;
+  VkSemaphore _transferSemaphore;
+  uint64_t _transferValue = 0;
+  std::deque<PendingUpload> _pending;
+  Vector<VkCommandBuffer> _freeTransferCommandBuffers;
+  Vector<VkCommandBuffer> _freeAcquireCommandBuffers;
+
+  // acquire half of the ownership transfers not yet recorded by acquire
+  Vector<VkBufferMemoryBarrier2> _acquireBufferBarriers;
+  Vector<VkImageMemoryBarrier2> _acquireImageBarriers;
+
   DeletionQueue _deletionQueue;
 };
 
@@ -5,7 +5,12 @@
 #include <fastgltf/tools.hpp>
 
 #include "core/device.h"
+#include "core/mesh_optimizer.h"
+#include "core/mesh_simplifier.h"
+#include "core/meshlet_builder.h"
+#include "core/vertex_quantizer.h"
 #include "gpu/gpu_mesh_buffers.h"
+#include "gpu/gpu_object.h"
 #include "utils/utils.h"
 
 namespace bisky {
@@ -15,6 +20,12 @@ class Engine;
 struct GeoSurface {
   uint32_t startIndex;
   uint32_t count;
+  Bounds bounds;
+  // the first level is the surface itself
+  Vector<MeshLod> lods;
+  // clusters of the full detail level in MeshAsset::meshlets
+  uint32_t firstMeshlet;
+  uint32_t meshletCount;
 };
 
 struct MeshAsset {
@@ -22,18 +33,29 @@ struct MeshAsset {
 
   Vector<GeoSurface> surfaces;
   GPUMeshBuffers meshBuffers;
+  MeshletData meshlets;
+  // dequantizes the positions of meshBuffers.compactVertexBuffer
+  VertexQuantization quantization;
 };
 
 namespace core {
 
 class MeshLoader {
 public:
+  // every level targets half the triangles of the previous one
+  static constexpr uint32_t LOD_COUNT = 4;
+  static constexpr float LOD_MAX_ERROR = 0.1f;
+  // trades a little vertex cache efficiency for less overdraw
+  static constexpr bool OPTIMIZE_OVERDRAW = true;
+
   MeshLoader();
   ~MeshLoader();
 
   static std::optional<Vector<Pointer<MeshAsset>>> loadGltfMeshes(Pointer<core::Device> device,
                                                                   Pointer<core::ImmediateSubmit> immediateSubmit,
                                                                   std::filesystem::path filePath) {
+    BISKY_PROFILE_ZONE("MeshLoader::loadGltfMeshes");
+
     auto data = fastgltf::GltfDataBuffer::FromPath(filePath);
     if (data.error() != fastgltf::Error::None) {
       return {};
@@ -55,6 +77,7 @@ public:
     Vector<Pointer<MeshAsset>> meshes;
     Vector<Vertex> vertices;
     Vector<uint32_t> indices;
+    Vector<CompactVertex> compactVertices;
     for (fastgltf::Mesh &mesh : gltf.meshes) {
       MeshAsset newMesh;
 
@@ -116,9 +139,33 @@ public:
               [&](glm::vec4 v, size_t index) { vertices[initialVertex + index].color = v; });
         }
 
+        // axis aligned box and bounding sphere around the center of the surface's vertices
+        glm::vec3 minPos = vertices[initialVertex].position;
+        glm::vec3 maxPos = vertices[initialVertex].position;
+        for (size_t i = initialVertex; i < vertices.size(); i++) {
+          minPos = glm::min(minPos, vertices[i].position);
+          maxPos = glm::max(maxPos, vertices[i].position);
+        }
+
+        surface.bounds.origin = (maxPos + minPos) / 2.0f;
+        surface.bounds.extents = (maxPos - minPos) / 2.0f;
+        surface.bounds.sphereRadius = glm::length(surface.bounds.extents);
+
         newMesh.surfaces.push_back(surface);
       }
 
+      // the levels are simplified from the cache optimized surfaces, the vertex order is only fixed once every index
+      // is known, and the meshlets reference the final vertices. The cache miss ratios of the surfaces as loaded and
+      // as optimized only show up in the cpu trace
+      [[maybe_unused]] const size_t surfaceIndexCount = indices.size();
+      BISKY_PROFILE_COUNTER("mesh acmr loaded", MeshOptimizer::averageCacheMissRatio(indices, vertices.size()));
+      optimizeSurfaces(newMesh, vertices, indices);
+      generateLods(newMesh, vertices, indices);
+      MeshOptimizer::optimizeVertexFetch(vertices, indices);
+      buildMeshlets(newMesh, vertices, indices);
+      BISKY_PROFILE_COUNTER("mesh acmr optimized", MeshOptimizer::averageCacheMissRatio(
+                                                       std::span(indices).first(surfaceIndexCount), vertices.size()));
+
       constexpr bool overrideColors = true;
       if (overrideColors) {
         for (Vertex &vtx : vertices) {
@@ -126,8 +173,10 @@ public:
         }
       }
 
+      newMesh.quantization = VertexQuantizer::quantize(vertices, compactVertices);
+
       // newMesh.meshBuffers = engine->uploadMesh(indices, vertices);
-      newMesh.meshBuffers = utils::uploadMesh(device, immediateSubmit, indices, vertices);
+      newMesh.meshBuffers = utils::uploadMesh(device, immediateSubmit, indices, vertices, compactVertices);
       meshes.emplace_back(std::make_shared<MeshAsset>(std::move(newMesh)));
     }
 
@@ -135,6 +184,57 @@ public:
   }
 
 private:
+  static void optimizeSurfaces(MeshAsset &mesh, std::span<const Vertex> vertices, Vector<uint32_t> &indices) {
+    BISKY_PROFILE_ZONE("MeshLoader::optimizeSurfaces");
+
+    for (const GeoSurface &surface : mesh.surfaces) {
+      std::span<uint32_t> surfaceIndices = std::span(indices).subspan(surface.startIndex, surface.count);
+      MeshOptimizer::optimizeVertexCache(surfaceIndices, vertices.size());
+      if (OPTIMIZE_OVERDRAW) {
+        MeshOptimizer::optimizeOverdraw(surfaceIndices, vertices);
+      }
+    }
+  }
+
+  static void buildMeshlets(MeshAsset &mesh, std::span<const Vertex> vertices, std::span<const uint32_t> indices) {
+    BISKY_PROFILE_ZONE("MeshLoader::buildMeshlets");
+
+    for (GeoSurface &surface : mesh.surfaces) {
+      surface.firstMeshlet = static_cast<uint32_t>(mesh.meshlets.meshlets.size());
+      surface.meshletCount =
+          MeshletBuilder::build(vertices, indices.subspan(surface.startIndex, surface.count), mesh.meshlets);
+    }
+  }
+
+  // appends the simplified levels of every surface to the mesh's index buffer, they reuse its vertices
+  static void generateLods(MeshAsset &mesh, std::span<const Vertex> vertices, Vector<uint32_t> &indices) {
+    BISKY_PROFILE_ZONE("MeshLoader::generateLods");
+
+    for (GeoSurface &surface : mesh.surfaces) {
+      surface.lods.push_back(MeshLod{surface.startIndex, surface.count, 0.0f});
+
+      const Vector<uint32_t> source(indices.begin() + surface.startIndex,
+                                    indices.begin() + surface.startIndex + surface.count);
+      size_t targetIndexCount = surface.count;
+      for (uint32_t level = 1; level < LOD_COUNT; level++) {
+        targetIndexCount = targetIndexCount / 6 * 3;
+
+        float error = 0.0f;
+        Vector<uint32_t> lod = MeshSimplifier::simplify(vertices, source, targetIndexCount, LOD_MAX_ERROR, &error);
+        MeshOptimizer::optimizeVertexCache(lod, vertices.size());
+
+        // locked borders or the error bound stop the simplifier, a level barely smaller than the last is not worth it
+        const MeshLod &previous = surface.lods.back();
+        if (lod.empty() || lod.size() * 10 > previous.indexCount * 9) {
+          break;
+        }
+
+        surface.lods.push_back(MeshLod{static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lod.size()),
+                                       std::max(error, previous.error)});
+        indices.insert(indices.end(), lod.begin(), lod.end());
+      }
+    }
+  }
 };
 
 } // namespace core
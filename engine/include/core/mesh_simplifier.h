@@ -0,0 +1,50 @@
+#pragma once
+
+#include "pch.h"
+#include <span>
+
+namespace bisky {
+namespace core {
+
+/**
+ * Reduces the triangle count of an indexed mesh by collapsing edges in order of their quadric error. Every collapse
+ * moves a vertex onto one of its neighbours, so the simplified indices reference the original vertices and can share
+ * their vertex buffer.
+ *
+ * vertices on open borders and on attribute seams (several vertices at one position) never move, which keeps the
+ * outline and the uv layout intact at the cost of a less aggressive reduction around them.
+ */
+class MeshSimplifier {
+public:
+  // max error is relative to the extent of the mesh, the reached error is returned in object space units
+  static Vector<uint32_t> simplify(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                                   size_t targetIndexCount, float maxError, float *resultError = nullptr);
+
+private:
+  // symmetric 4x4 plane quadric, weighted by triangle area
+  struct Quadric {
+    double a00, a11, a22, a10, a20, a21;
+    double b0, b1, b2;
+    double c;
+    double weight;
+
+    static Quadric fromPlane(const glm::dvec3 &normal, double distance, double weight);
+    Quadric &operator+=(const Quadric &other);
+    // weighted mean of the squared distances to the accumulated planes
+    double error(const glm::vec3 &point) const;
+  };
+
+  struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double error;
+  };
+
+  static void lockBordersAndSeams(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                                  Vector<uint8_t> &locked);
+  static bool flipsTriangle(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                            std::span<const uint32_t> triangles, const Collapse &collapse);
+};
+
+} // namespace core
+} // namespace bisky
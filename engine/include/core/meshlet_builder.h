@@ -0,0 +1,51 @@
+#pragma once
+
+#include "pch.h"
+#include <span>
+
+namespace bisky {
+
+struct Meshlet {
+  // bounding sphere and normal cone in object space, a cutoff of 1 means the cone cannot be backface culled
+  glm::vec3 center;
+  float radius;
+  glm::vec3 coneAxis;
+  float coneCutoff;
+
+  // ranges of MeshletData::vertices and MeshletData::triangles
+  uint32_t vertexOffset;
+  uint32_t triangleOffset;
+  uint32_t vertexCount;
+  uint32_t triangleCount;
+};
+
+struct MeshletData {
+  Vector<Meshlet> meshlets;
+  // indices into the mesh's vertex buffer
+  Vector<uint32_t> vertices;
+  // three 8 bit indices into the meshlet's vertices per triangle, packed into the low 24 bits
+  Vector<uint32_t> triangles;
+};
+
+namespace core {
+
+/**
+ * Splits an index stream into clusters of at most MAX_VERTICES vertices and MAX_TRIANGLES triangles in index order,
+ * so a well ordered index buffer gives spatially compact clusters. Each cluster gets a bounding sphere and a cone
+ * around its triangle normals for culling whole clusters that face away from the camera.
+ */
+class MeshletBuilder {
+public:
+  // the common limits for mesh shader hardware, so the same clusters could be drawn with mesh shaders later
+  static constexpr uint32_t MAX_VERTICES = 64;
+  static constexpr uint32_t MAX_TRIANGLES = 124;
+
+  // appends the clusters of the indices to data, returns the number of clusters added
+  static uint32_t build(std::span<const Vertex> vertices, std::span<const uint32_t> indices, MeshletData &data);
+
+private:
+  static void computeBounds(std::span<const Vertex> vertices, const MeshletData &data, Meshlet &meshlet);
+};
+
+} // namespace core
+} // namespace bisky
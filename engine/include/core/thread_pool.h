@@ -0,0 +1,41 @@
+#pragma once
+
+#include "pch.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace bisky {
+namespace core {
+
+/**
+ * Fixed set of worker threads for fork/join work like command recording. Only one parallelFor may run at a time.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(uint32_t threadCount);
+  ~ThreadPool();
+
+  // runs task(i) for every i in [0, count) on the workers and returns once all of them have finished
+  void parallelFor(uint32_t count, const std::function<void(uint32_t)> &task);
+
+  uint32_t size() { return static_cast<uint32_t>(_threads.size()); }
+
+private:
+  void workerLoop();
+
+  Vector<std::thread> _threads;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _done;
+
+  const std::function<void(uint32_t)> *_task = nullptr;
+  uint32_t _count = 0;
+  uint32_t _next = 0;
+  uint32_t _remaining = 0;
+  bool _stop = false;
+};
+
+} // namespace core
+} // namespace bisky
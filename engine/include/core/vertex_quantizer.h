@@ -0,0 +1,31 @@
+#pragma once
+
+#include "pch.h"
+#include <span>
+
+namespace bisky {
+
+// maps the unorm16 positions of a CompactVertex back into object space: offset + position * scale
+struct VertexQuantization {
+  glm::vec3 offset;
+  glm::vec3 scale;
+};
+
+namespace core {
+
+/**
+ * Packs vertices into CompactVertex. Positions are quantized to 16 bits within the bounding box of all vertices,
+ * which keeps the error below 1/65535 of the mesh's extent, normals are octahedral encoded, uvs stored as half floats
+ * and colors as unorm8, so colors outside of [0, 1] are clamped.
+ */
+class VertexQuantizer {
+public:
+  static VertexQuantization quantize(std::span<const Vertex> vertices, Vector<CompactVertex> &compactVertices);
+
+private:
+  // maps the unit sphere onto the [-1, 1] square
+  static glm::vec2 encodeOctahedral(glm::vec3 normal);
+};
+
+} // namespace core
+} // namespace bisky
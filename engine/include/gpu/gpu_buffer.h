@@ -11,12 +11,15 @@ public:
   };
 
   friend class GPUMeshBuffers;
+  friend class GPURingBuffer;
 
   void cleanup(VmaAllocator allocator);
 
   VkBuffer buffer;
   VmaAllocation allocation;
   VmaAllocationInfo info;
+  // as requested, the allocation may be larger
+  size_t size = 0;
 
 private:
   GPUBuffer() = default;
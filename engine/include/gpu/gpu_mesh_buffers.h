@@ -6,8 +6,12 @@ namespace bisky {
 
 struct GPUMeshBuffers {
   GPUBuffer indexBuffer;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT32;
   GPUBuffer vertexBuffer;
   VkDeviceAddress vertexBufferAddress;
+  // the same vertices as CompactVertex
+  GPUBuffer compactVertexBuffer;
+  VkDeviceAddress compactVertexBufferAddress;
 
   void cleanup(VmaAllocator allocator);
 };
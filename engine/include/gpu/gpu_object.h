@@ -1,6 +1,7 @@
 #pragma once
 
 #include "pch.h"
+#include <span>
 
 namespace bisky {
 
@@ -13,18 +14,40 @@ struct MaterialPipeline {
 
 struct MaterialInstance {
   Pointer<MaterialPipeline> pipeline;
-  VkDescriptorSet materialSet;
+  // bindless indices, see Renderer::createImage
+  uint32_t textureIndex;
+  uint32_t samplerIndex;
   MaterialPass passType;
 };
 
+struct Bounds {
+  glm::vec3 origin;
+  float sphereRadius;
+  glm::vec3 extents;
+};
+
+// an index range of a surface, all levels of a surface share its vertices
+struct MeshLod {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  // object space distance the level deviates from the full surface
+  float error;
+};
+
 struct GPUObject {
   uint32_t indexCount;
   uint32_t firstIndex;
+  // finest first, empty when the surface has no simplified levels
+  std::span<const MeshLod> lods;
 
   Pointer<MaterialInstance> material;
 
   VkBuffer indexBuffer;
+  VkIndexType indexType;
   VkDeviceAddress vertexBufferAddress;
+
+  glm::mat4 transform;
+  Bounds bounds;
 };
 
 } // namespace bisky
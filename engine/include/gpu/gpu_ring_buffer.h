@@ -0,0 +1,43 @@
+#pragma once
+
+#include "gpu/gpu_buffer.h"
+
+namespace bisky {
+
+/**
+ * Persistently mapped host visible buffer that is bump allocated during a frame and reclaimed as a whole once the
+ * frame's fence has signaled. Allocations are aligned so their offsets can be used as dynamic descriptor offsets.
+ */
+class GPURingBuffer {
+public:
+  struct Allocation {
+    void *data;
+    uint32_t offset;
+  };
+
+  void init(VkDevice device, VmaAllocator allocator, size_t size, size_t alignment, VkBufferUsageFlags usage);
+  void cleanup(VmaAllocator allocator);
+
+  Allocation allocate(size_t size);
+  void reset() { _head = 0; }
+
+  template <typename T> uint32_t push(const T &value) {
+    Allocation allocation = allocate(sizeof(T));
+    memcpy(allocation.data, &value, sizeof(T));
+    return allocation.offset;
+  }
+
+  VkBuffer buffer() { return _buffer.buffer; }
+  VkDeviceAddress deviceAddress() { return _deviceAddress; }
+  size_t size() { return _size; }
+  size_t used() { return _head; }
+
+private:
+  GPUBuffer _buffer;
+  VkDeviceAddress _deviceAddress = 0;
+  size_t _size = 0;
+  size_t _alignment = 1;
+  size_t _head = 0;
+};
+
+} // namespace bisky
@@ -4,6 +4,18 @@
 
 namespace bisky {
 
+// Must match Light in light_cull.slang and the mesh shaders
+struct GPULight {
+  glm::vec3 position;
+  float radius;
+  glm::vec3 color;
+  float intensity;
+  // spot lights point along direction, lighting everything within the cone whose half angle has this cosine
+  glm::vec3 direction;
+  // -1 for point lights
+  float spotCosine;
+};
+
 struct GPUSceneData {
   glm::mat4 view;
   glm::mat4 proj;
@@ -11,6 +23,14 @@ struct GPUSceneData {
   glm::vec4 ambientColor;
   glm::vec4 sunlightDirection;
   glm::vec4 sunlightColor;
+
+  // written by LightCuller::prepare, no clustered lights are shaded while lightCount is 0
+  VkDeviceAddress lights;
+  VkDeviceAddress clusterLights;
+  // clusters in x, y and z, the number of lights in w
+  glm::uvec4 clusterCount;
+  // clusters per pixel in xy, the depth slice is log(viewDepth) * z - w
+  glm::vec4 clusterScale;
 };
 
 } // namespace bisky
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "core/deletion_queue.h"
+#include "core/descriptor_cache.h"
+#include "core/image_state_tracker.h"
+#include "pch.h"
+#include <slang-com-ptr.h>
+
+namespace bisky {
+
+namespace core {
+
+class Device;
+
+} // namespace core
+
+namespace rendering {
+
+struct GPUDepthPyramidPushConstants {
+  glm::uvec2 sourceSize;
+  glm::uvec2 size;
+  uint32_t fromDepth;
+};
+
+/**
+ * Hierarchical depth buffer for occlusion culling, every texel keeps the minimum and maximum depth of the region it
+ * covers. Level 0 is the largest power of two that fits the draw extent, so the levels above halve it exactly and
+ * only level 0 reads a footprint of up to 3x3 depth texels.
+ *
+ * with reverse-Z the minimum is the farthest depth, bounds whose nearest depth is below the minimum of every texel
+ * they cover are hidden.
+ */
+class DepthPyramid {
+public:
+  static constexpr VkFormat FORMAT = VK_FORMAT_R32G32_SFLOAT;
+
+  DepthPyramid(Pointer<core::Device> device, Pointer<core::DescriptorCache> descriptorCache);
+  ~DepthPyramid();
+
+  void cleanup();
+
+  void buildPipeline(Slang::ComPtr<slang::ISession> session);
+  // sized for draws up to extent, the previous image is destroyed when retired is flushed
+  void resize(VkExtent2D extent, core::DeletionQueue *retired = nullptr);
+
+  // moves a newly created pyramid into its GENERAL layout, so it can be bound before its first build
+  void initializeLayout(VkCommandBuffer cmd);
+  // depth has to be in SHADER_READ_ONLY_OPTIMAL, the pyramid is left readable by compute shaders
+  void build(VkCommandBuffer cmd, VkImageView depth, VkExtent2D drawExtent);
+
+  VkImageView view() { return _image.imageView; }
+  // of level 0 in the last build
+  VkExtent2D size() { return _size; }
+  uint32_t levelCount() { return _levelCount; }
+
+private:
+  void barrier(VkCommandBuffer cmd, const core::ImageState &next);
+  void releaseImage(core::DeletionQueue *retired);
+
+  Pointer<core::Device> _device;
+  Pointer<core::DescriptorCache> _descriptorCache;
+
+  AllocatedImage _image = {};
+  Vector<VkImageView> _levelViews;
+  core::ImageState _state = {};
+  VkExtent2D _size = {1, 1};
+  uint32_t _levelCount = 1;
+
+  VkDescriptorSetLayout _descriptorLayout;
+  VkPipelineLayout _pipelineLayout;
+  VkPipeline _pipeline;
+
+  core::DeletionQueue _deletionQueue;
+};
+
+} // namespace rendering
+} // namespace bisky
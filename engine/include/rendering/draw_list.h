@@ -0,0 +1,86 @@
+#pragma once
+
+#include "pch.h"
+#include "gpu/gpu_ring_buffer.h"
+#include "rendering/renderable.h"
+#include <span>
+#include <unordered_map>
+
+namespace bisky {
+namespace rendering {
+
+/**
+ * Sorts the objects of a RenderContext by a 64 bit state key so that consecutive draws share as much bound state as
+ * possible, then records them binding pipelines and index buffers only when they change. Materials reach their
+ * textures through indices in the instance data, so the bindless set is only rebound with the pipeline. Runs of
+ * objects drawing the same surface with the same state collapse into one instanced draw.
+ *
+ * prepare() groups the sorted objects into those batches, after which disjoint batch ranges can be recorded into
+ * different command buffers concurrently. Objects drawn at different levels of detail are different surfaces.
+ *
+ * key layout (msb to lsb): pass (2) | pipeline (10) | material (20) | index buffer (16) | surface (16)
+ */
+class DrawList {
+public:
+  struct Stats {
+    uint32_t draws;
+    uint32_t instances;
+    uint32_t pipelineBinds;
+    uint32_t descriptorBinds;
+    uint32_t indexBufferBinds;
+
+    Stats &operator+=(const Stats &other) {
+      draws += other.draws;
+      instances += other.instances;
+      pipelineBinds += other.pipelineBinds;
+      descriptorBinds += other.descriptorBinds;
+      indexBufferBinds += other.indexBufferBinds;
+      return *this;
+    }
+  };
+
+  // levels parallel visible, without them every object draws its full surface
+  void build(const RenderContext &context, std::span<const uint32_t> visible, std::span<const uint8_t> levels = {});
+  uint32_t prepare(GPURingBuffer &instanceRing);
+  Stats record(VkCommandBuffer cmd, uint32_t firstBatch, uint32_t batchCount, VkDescriptorSet textureSet,
+               VkDescriptorSet sceneSet, uint32_t sceneOffset) const;
+  void clear();
+
+  uint32_t batchCount() { return static_cast<uint32_t>(_batches.size()); }
+
+private:
+  struct SortEntry {
+    uint64_t key;
+    uint32_t index;
+    uint32_t level;
+  };
+
+  // a run of sorted entries drawn with one instanced draw
+  struct Batch {
+    uint32_t firstEntry;
+    uint32_t instanceCount;
+  };
+
+  uint64_t makeKey(const GPUObject &object, uint32_t level);
+  uint32_t resourceId(std::unordered_map<uint64_t, uint32_t> &ids, uint64_t handle);
+
+  static void radixSort(Vector<SortEntry> &entries, Vector<SortEntry> &scratch);
+
+  const RenderContext *_context = nullptr;
+  Vector<SortEntry> _entries;
+  Vector<SortEntry> _scratch;
+  Vector<Batch> _batches;
+
+  // instance data of entry i lives at index i, written while recording its batch
+  GPUInstanceData *_instanceData = nullptr;
+  VkDeviceAddress _instanceAddress = 0;
+
+  // dense ids for vulkan handles, stable across frames so keys stay comparable
+  std::unordered_map<uint64_t, uint32_t> _pipelineIds;
+  std::unordered_map<uint64_t, uint32_t> _materialIds;
+  std::unordered_map<uint64_t, uint32_t> _indexBufferIds;
+  std::unordered_map<uint64_t, uint32_t> _surfaceIds;
+};
+
+} // namespace rendering
+} // namespace bisky
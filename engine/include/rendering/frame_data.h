@@ -2,20 +2,41 @@
 
 #include "core/deletion_queue.h"
 #include "core/descriptor_allocator_growable.h"
+#include "gpu/gpu_ring_buffer.h"
 #include "pch.h"
 
 namespace bisky {
 namespace rendering {
 
+// secondary command buffer recorded by one worker, reset with its pool every frame
+struct WorkerCommands {
+  VkCommandPool commandPool;
+  VkCommandBuffer commandBuffer;
+};
+
 struct FrameData {
   VkCommandPool commandPool;
   VkCommandBuffer mainCommandBuffer;
+  Vector<WorkerCommands> workers;
   VkSemaphore swapchainSemaphore;
   VkSemaphore renderSemaphore;
   VkFence renderFence;
 
+  // async compute, the graphics submit waits on computeSemaphore when computeSubmitted is set
+  VkCommandPool computeCommandPool;
+  VkCommandBuffer computeCommandBuffer;
+  VkSemaphore computeSemaphore;
+  bool computeSubmitted = false;
+
+  AllocatedImage drawImage;
+  VkDescriptorSet drawImageDescriptors;
+
   core::DescriptorAllocatorGrowable frameDescriptors;
   core::DeletionQueue deletionQueue;
+
+  // per frame constants, reset once renderFence has signaled
+  GPURingBuffer uniformRing;
+  VkDescriptorSet sceneDescriptors;
 };
 
 } // namespace rendering
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "pch.h"
+#include <algorithm>
+
+namespace bisky {
+namespace rendering {
+
+/**
+ * Measures the latency from submitting a frame on the CPU until the GPU has finished it, and decides how many frames
+ * may be queued ahead of the GPU. A depth of one makes the CPU wait for the previous frame before sampling input,
+ * which trades throughput for the lowest latency, the full frames in flight keep the GPU busiest.
+ *
+ * completion is observed when a fence wait returns, so frames that finished long before are reported late.
+ */
+class FramePacer {
+public:
+  static constexpr uint32_t HISTORY = 64;
+
+  explicit FramePacer(uint32_t frameCount = 1);
+
+  void submitted(uint32_t frame);
+  // only the first call after a submit records a latency
+  void completed(uint32_t frame);
+
+  uint32_t queuedFrames() { return _queuedFrames; }
+  void setQueuedFrames(uint32_t frames) { _queuedFrames = std::clamp(frames, 1u, _frameCount); }
+
+  // milliseconds
+  float latency() const { return _latencies[(_count + HISTORY - 1) % HISTORY]; }
+  float averageLatency() const;
+
+private:
+  uint32_t _frameCount;
+  uint32_t _queuedFrames;
+
+  Vector<uint64_t> _submitTimes;
+  std::array<float, HISTORY> _latencies = {};
+  uint32_t _count = 0;
+};
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "pch.h"
+#include "rendering/renderable.h"
+
+namespace bisky {
+namespace rendering {
+
+/**
+ * Tests the bounds of every object in a RenderContext against the camera frustum. The world space boxes are laid out
+ * as structure of arrays so that 8 (AVX), 4 (SSE, NEON) or 1 (scalar) boxes are tested per iteration.
+ */
+class FrustumCuller {
+public:
+  const Vector<uint32_t> &cull(const RenderContext &context, const glm::mat4 &viewproj);
+
+  const Vector<uint32_t> &visible() { return _visible; }
+
+  static uint32_t lanes();
+
+private:
+  void gatherBounds(const RenderContext &context);
+
+  Vector<float> _centerX;
+  Vector<float> _centerY;
+  Vector<float> _centerZ;
+  Vector<float> _extentX;
+  Vector<float> _extentY;
+  Vector<float> _extentZ;
+
+  Vector<uint32_t> _visible;
+};
+
+} // namespace rendering
+} // namespace bisky
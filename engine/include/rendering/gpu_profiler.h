@@ -0,0 +1,102 @@
+#pragma once
+
+#include "pch.h"
+#include <string>
+#include <unordered_map>
+
+namespace bisky {
+
+namespace core {
+
+class Device;
+
+} // namespace core
+
+namespace rendering {
+
+/**
+ * Measures GPU time per named zone with timestamp queries, using one query pool per frame in flight. A frame's
+ * results are collected when its slot is reused, after its fence has been waited on, so reading them never stalls.
+ */
+class GpuProfiler {
+public:
+  static constexpr uint32_t MAX_ZONES = 64;
+  static constexpr uint32_t HISTORY = 128;
+  static constexpr uint32_t INVALID_ZONE = UINT32_MAX;
+
+  // rolling timings of a zone in milliseconds, oldest samples are overwritten first
+  struct Timing {
+    std::string name;
+    std::array<float, HISTORY> history = {};
+    uint32_t count = 0;
+
+    uint32_t samples() const { return std::min(count, HISTORY); }
+    float last() const { return count ? history[(count - 1) % HISTORY] : 0.0f; }
+    float average() const;
+    float min() const;
+    float max() const;
+  };
+
+  // RAII zone, records nothing when the profiler is disabled
+  class Scope {
+  public:
+    Scope(GpuProfiler &profiler, VkCommandBuffer cmd, const std::string &name, bool compute = false)
+        : _profiler(profiler), _cmd(cmd), _zone(profiler.beginZone(cmd, name, compute)) {}
+    ~Scope() { _profiler.endZone(_cmd, _zone); }
+
+  private:
+    GpuProfiler &_profiler;
+    VkCommandBuffer _cmd;
+    uint32_t _zone;
+  };
+
+  GpuProfiler(Pointer<core::Device> device, uint32_t frameCount);
+  ~GpuProfiler();
+
+  void cleanup();
+
+  // collects the zones previously recorded for this frame slot and resets its queries on the host
+  void beginFrame(uint32_t frame);
+
+  // compute zones are recorded on the async compute queue, which may not support timestamps
+  uint32_t beginZone(VkCommandBuffer cmd, const std::string &name, bool compute = false);
+  void endZone(VkCommandBuffer cmd, uint32_t zone);
+
+  bool enabled() { return _enabled; }
+  void setEnabled(bool enabled) { _enabled = enabled && _supported; }
+  const Vector<Timing> &timings() { return _timings; }
+  // null until the zone has been measured once
+  const Timing *timing(const std::string &name);
+  void writeJson(const std::string &path);
+
+private:
+  struct Zone {
+    std::string name;
+    uint64_t mask;
+  };
+
+  struct FrameQueries {
+    VkQueryPool pool = VK_NULL_HANDLE;
+    Vector<Zone> zones;
+  };
+
+  void record(const std::string &name, float milliseconds);
+
+  Pointer<core::Device> _device;
+
+  Vector<FrameQueries> _frames;
+  uint32_t _frame = 0;
+
+  // nanoseconds per tick and the valid bits of the graphics and compute queue timestamps
+  float _period = 1.0f;
+  uint64_t _graphicsMask = 0;
+  uint64_t _computeMask = 0;
+  bool _supported = false;
+  bool _enabled = false;
+
+  Vector<Timing> _timings;
+  std::unordered_map<std::string, uint32_t> _timingIds;
+};
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "core/deletion_queue.h"
+#include "core/descriptor_cache.h"
+#include "core/mesh_loader.h"
+#include "gpu/gpu_buffer.h"
+#include "pch.h"
+#include "rendering/depth_pyramid.h"
+#include <slang-com-ptr.h>
+
+namespace bisky {
+
+namespace core {
+
+class Device;
+class ImmediateSubmit;
+
+} // namespace core
+
+namespace rendering {
+
+/**
+ * One record per MeshAsset surface, read by the cull compute shader and the indirect vertex shader. Its levels of
+ * detail are lodCount MeshLods from firstLod on, which match Lod in cull.slang.
+ * Must match DrawRecord in cull.slang and indirect_mesh.slang.
+ */
+struct GPUDrawRecord {
+  glm::vec4 sphere;
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  uint32_t batch;
+  uint32_t commandOffset;
+  VkDeviceAddress vertexBuffer;
+  uint32_t firstLod;
+  uint32_t lodCount;
+  // the mesh's CompactVertex buffer and its VertexQuantization, w unused
+  VkDeviceAddress compactVertexBuffer;
+  uint32_t padding[2];
+  glm::vec4 positionOffset;
+  glm::vec4 positionScale;
+};
+
+/**
+ * One cluster of a surface's full detail level, compacted into the index buffer of its batch by the cluster cull
+ * shader.
+ * Must match Meshlet in cluster_cull.slang.
+ */
+struct GPUMeshlet {
+  glm::vec4 sphere;
+  // axis and cutoff of the normal cone
+  glm::vec4 cone;
+  uint32_t vertexOffset;
+  uint32_t triangleOffset;
+  uint32_t triangleCount;
+  uint32_t batch;
+};
+
+enum class CullPhase : uint32_t {
+  // frustum culling only
+  ALL,
+  // the records visible last frame
+  EARLY,
+  // every record against the depth pyramid of the early draws, drawing the ones the early phase missed
+  LATE,
+};
+
+// also used by the cluster cull shader, where drawCount is the number of meshlets
+struct GPUCullPushConstants {
+  glm::vec4 planes[6];
+  // camera position, w scales lod errors to multiples of the pixel threshold at distance one
+  glm::vec4 camera;
+  uint32_t drawCount;
+  uint32_t phase;
+};
+
+// Must match OcclusionData in cull.slang.
+struct GPUOcclusionData {
+  glm::mat4 viewproj;
+  glm::vec2 pyramidSize;
+  uint32_t pyramidLevels;
+  uint32_t padding;
+};
+
+struct GPUIndirectPushConstants {
+  glm::mat4 viewproj;
+  VkDeviceAddress drawRecords;
+  // the fragment shader lights with the frame's GPUSceneData
+  VkDeviceAddress sceneData;
+};
+
+/**
+ * GPU driven drawing of every surface of a set of meshes. A compute pass frustum culls the draw records, picks their
+ * level of detail like LodSelector and compacts the survivors into VkDrawIndexedIndirectCommands, which are then
+ * drawn with one vkCmdDrawIndexedIndirectCount per index buffer.
+ *
+ * with cluster culling the meshlets of the surfaces are culled instead, by frustum and normal cone. Each visible
+ * meshlet writes its triangles into a per frame index buffer, so every batch is drawn with a single indirect command
+ * whose index count the shader accumulates. Clusters are only built for the full detail level.
+ *
+ * occlusion culling is two phased: the records visible last frame are drawn first, the depth pyramid is built from
+ * them and every record is tested against it, drawing the newly visible ones in a second pass.
+ */
+class IndirectDrawer {
+public:
+  IndirectDrawer(Pointer<core::Device> device, Pointer<core::ImmediateSubmit> immediateSubmit,
+                 Pointer<core::DescriptorCache> descriptorCache, uint32_t frameCount);
+  ~IndirectDrawer();
+
+  void cleanup();
+
+  void buildPipelines(Slang::ComPtr<slang::ISession> session, VkFormat colorFormat, VkFormat depthFormat);
+  void upload(const Vector<Pointer<MeshAsset>> &meshes);
+
+  // the pyramid is only bound here, it is read by cullLate once rebuilt from the early draws
+  void cull(VkCommandBuffer cmd, uint32_t frame, const glm::mat4 &viewproj, const glm::vec3 &cameraPosition,
+            float lodScale, DepthPyramid &pyramid);
+  void cullLate(VkCommandBuffer cmd, uint32_t frame, DepthPyramid &pyramid);
+  void draw(VkCommandBuffer cmd, uint32_t frame, const glm::mat4 &viewproj, VkDeviceAddress sceneData);
+  void drawLate(VkCommandBuffer cmd, uint32_t frame, const glm::mat4 &viewproj, VkDeviceAddress sceneData);
+
+  // whether the frame's cull decided on the two phases, the late passes are skipped otherwise
+  bool occlusionActive(uint32_t frame) { return !_frames.empty() && _frames[frame].occlusion; }
+
+  uint32_t drawCount() { return static_cast<uint32_t>(_records.size()); }
+  uint32_t meshletCount() { return static_cast<uint32_t>(_meshlets.size()); }
+  bool &clusterCulling() { return _clusterCulling; }
+  bool &compactVertices() { return _compactVertices; }
+  bool &occlusionCulling() { return _occlusionCulling; }
+
+private:
+  struct Batch {
+    VkBuffer indexBuffer;
+    VkIndexType indexType;
+    uint32_t firstDraw;
+    uint32_t drawCount;
+  };
+
+  struct FrameResources {
+    GPUBuffer commandBuffer;
+    GPUBuffer countBuffer;
+    GPUBuffer lateCommandBuffer;
+    GPUBuffer lateCountBuffer;
+    GPUBuffer occlusionBuffer;
+    GPUBuffer clusterCommandBuffer;
+    GPUBuffer clusterIndexBuffer;
+
+    // recorded by the early cull for the late one
+    GPUCullPushConstants pushConstants = {};
+    glm::mat4 viewproj = glm::mat4(1.0f);
+    bool occlusion = false;
+  };
+
+  void releaseBuffers();
+  GPUBuffer uploadBuffer(const void *data, size_t size, VkBufferUsageFlags usage, VkPipelineStageFlags2 stages,
+                         VkAccessFlags2 access);
+  void dispatchCull(VkCommandBuffer cmd, FrameResources &resources, DepthPyramid &pyramid,
+                    const GPUBuffer &commandBuffer, const GPUBuffer &countBuffer);
+  void bindDrawPipeline(VkCommandBuffer cmd, const glm::mat4 &viewproj, VkDeviceAddress sceneData);
+  void drawBatches(VkCommandBuffer cmd, const GPUBuffer &commandBuffer, const GPUBuffer &countBuffer);
+  void cullClusters(VkCommandBuffer cmd, FrameResources &resources, const GPUCullPushConstants &pushConstants);
+
+  Pointer<core::Device> _device;
+  Pointer<core::ImmediateSubmit> _immediateSubmit;
+  Pointer<core::DescriptorCache> _descriptorCache;
+  uint32_t _frameCount;
+
+  Vector<GPUDrawRecord> _records;
+  Vector<MeshLod> _lods;
+  Vector<Batch> _batches;
+  std::optional<GPUBuffer> _recordBuffer;
+  std::optional<GPUBuffer> _lodBuffer;
+  VkDeviceAddress _recordBufferAddress = 0;
+  Vector<FrameResources> _frames;
+
+  bool _clusterCulling = false;
+  bool _compactVertices = true;
+  bool _occlusionCulling = true;
+  // one flag per record, written by the late phase and read by the next frame's early phase
+  std::optional<GPUBuffer> _visibilityBuffer;
+  Vector<GPUMeshlet> _meshlets;
+  // one command per batch with a zero index count, copied over the frame's cluster commands before culling
+  Vector<VkDrawIndexedIndirectCommand> _clusterCommands;
+  uint32_t _clusterIndexCount = 0;
+  std::optional<GPUBuffer> _meshletBuffer;
+  std::optional<GPUBuffer> _meshletVertexBuffer;
+  std::optional<GPUBuffer> _meshletTriangleBuffer;
+  std::optional<GPUBuffer> _clusterCommandTemplate;
+
+  VkDescriptorSetLayout _cullDescriptorLayout;
+  VkPipelineLayout _cullPipelineLayout;
+  VkPipeline _cullPipeline;
+  VkDescriptorSetLayout _clusterDescriptorLayout;
+  VkPipelineLayout _clusterPipelineLayout;
+  VkPipeline _clusterPipeline;
+  VkPipelineLayout _drawPipelineLayout;
+  VkPipeline _drawPipeline;
+  VkPipeline _compactDrawPipeline;
+
+  core::DeletionQueue _deletionQueue;
+};
+
+} // namespace rendering
+} // namespace bisky
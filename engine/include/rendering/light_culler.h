@@ -0,0 +1,73 @@
+#pragma once
+
+#include "core/deletion_queue.h"
+#include "gpu/gpu_buffer.h"
+#include "gpu/gpu_ring_buffer.h"
+#include "gpu/gpu_scene_data.h"
+#include "pch.h"
+#include <slang-com-ptr.h>
+
+namespace bisky {
+
+namespace core {
+
+class Device;
+
+} // namespace core
+
+namespace rendering {
+
+struct GPULightCullPushConstants {
+  VkDeviceAddress sceneData;
+};
+
+/**
+ * Clustered forward lighting. Every frame a compute pass bins the point and spot lights into a grid of froxels over
+ * the draw extent, tiles in screen space and exponentially spaced slices in view depth, and the mesh fragment shaders
+ * only shade the lights of the cluster they fall into.
+ *
+ * a cluster holds at most MAX_LIGHTS_PER_CLUSTER lights, the first word of its slot in the cluster buffer is the
+ * count and the light indices follow. Spot lights are binned by their bounding sphere.
+ */
+class LightCuller {
+public:
+  static constexpr uint32_t CLUSTERS_X = 16;
+  static constexpr uint32_t CLUSTERS_Y = 9;
+  static constexpr uint32_t CLUSTERS_Z = 24;
+  static constexpr uint32_t CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+  static constexpr uint32_t MAX_LIGHTS = 4096;
+  static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 127;
+
+  LightCuller(Pointer<core::Device> device, uint32_t frameCount);
+  ~LightCuller();
+
+  void cleanup();
+
+  void buildPipeline(Slang::ComPtr<slang::ISession> session);
+
+  // copies the lights into the frame's ring and points the scene data at them, before the scene data is pushed
+  void prepare(uint32_t frame, GPURingBuffer &ring, GPUSceneData &sceneData, VkExtent2D drawExtent, float nearDepth,
+               float farDepth);
+  // sceneData is the device address of the pushed scene data, the clusters are left readable by fragment shaders
+  void cull(VkCommandBuffer cmd, uint32_t frame, VkDeviceAddress sceneData);
+
+  // only the first MAX_LIGHTS are shaded
+  Vector<GPULight> &lights() { return _lights; }
+  uint32_t activeLightCount() { return std::min(static_cast<uint32_t>(_lights.size()), MAX_LIGHTS); }
+
+private:
+  Pointer<core::Device> _device;
+
+  Vector<GPULight> _lights;
+  Vector<GPUBuffer> _clusterBuffers;
+  Vector<VkDeviceAddress> _clusterAddresses;
+  uint32_t _lightCount = 0;
+
+  VkPipelineLayout _pipelineLayout;
+  VkPipeline _pipeline;
+
+  core::DeletionQueue _deletionQueue;
+};
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "pch.h"
+#include "rendering/renderable.h"
+#include <span>
+
+namespace bisky {
+namespace rendering {
+
+/**
+ * Picks the coarsest level of detail of every visible object whose error, projected to the screen at the distance of
+ * the object's bounding sphere, stays below a pixel threshold. Objects without levels always draw their full surface.
+ */
+class LodSelector {
+public:
+  // projection scale is pixels per unit at distance one, the view height in pixels times proj[1][1] over two
+  std::span<const uint8_t> select(const RenderContext &context, std::span<const uint32_t> visible,
+                                  const glm::vec3 &cameraPosition, float projectionScale);
+
+  float &threshold() { return _threshold; }
+  // triangles drawn with the selected levels and with the full surfaces, for the last selection
+  uint32_t triangles() { return _triangles; }
+  uint32_t fullTriangles() { return _fullTriangles; }
+
+private:
+  float _threshold = 1.0f;
+  Vector<uint8_t> _levels;
+  uint32_t _triangles = 0;
+  uint32_t _fullTriangles = 0;
+};
+
+} // namespace rendering
+} // namespace bisky
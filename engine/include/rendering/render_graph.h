@@ -1,20 +1,109 @@
 #pragma once
 
+#include "core/deletion_queue.h"
+#include "core/image_state_tracker.h"
 #include "pch.h"
 #include "render_pass.h"
+#include "rendering/gpu_profiler.h"
+#include <unordered_map>
 
 namespace bisky {
+
+namespace core {
+
+class Device;
+
+} // namespace core
+
 namespace rendering {
 
+/**
+ * Orders render passes on the attachments they read and write and records them with the barriers derived from
+ * those accesses, batched into one vkCmdPipelineBarrier2 per pass. Transient attachments are created by compile() and
+ * share memory whenever their lifetimes in the sorted pass order do not overlap.
+ *
+ * passes touching the same attachment keep their declaration order, images used across frames are expected to be
+ * fully rewritten every frame.
+ */
 class RenderGraph {
 public:
-  struct Builder {
-    RenderPass &addPass(const char *name, VkPipelineStageFlagBits stages);
-    RenderGraph build();
-  };
+  RenderGraph(Pointer<core::Device> device);
+  ~RenderGraph();
+
+  RenderPass &addPass(const char *name, VkPipelineStageFlags2 stages);
+
+  // initial is the state every frame starts in, the final layout is transitioned to after the last pass
+  void importImage(const std::string &name, VkImage image, VkImageView view, VkFormat format, core::ImageState initial,
+                   VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+  void setImage(const std::string &name, VkImage image, VkImageView view);
+
+  // every pass is timed as a zone named after it
+  void setProfiler(Pointer<GpuProfiler> profiler) { _profiler = profiler; }
+
+  void compile(VkExtent2D extent);
+  // recreates the transients at a new extent, the old ones are destroyed when retired is flushed
+  void resize(VkExtent2D extent, core::DeletionQueue &retired);
+  void execute(VkCommandBuffer cmd);
+  void cleanup();
+
+  VkImage image(const std::string &name) { return _resources[resourceIndex(name)].image; }
+  VkImageView imageView(const std::string &name) { return _resources[resourceIndex(name)].view; }
+  VkDeviceSize transientMemory() { return _transientMemory; }
 
 private:
-  std::unordered_map<const char *, RenderPass> _renderPasses;
+  struct Resource {
+    std::string name;
+    AttachmentInfo info;
+    bool imported = false;
+
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkImageUsageFlags usage = 0;
+
+    core::ImageState initial;
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    int32_t firstPass = -1;
+    int32_t lastPass = -1;
+    int32_t slot = -1;
+  };
+
+  struct MemorySlot {
+    VkMemoryRequirements requirements;
+    VmaAllocation allocation = VK_NULL_HANDLE;
+    Vector<uint32_t> resources;
+  };
+
+  struct Barrier {
+    uint32_t resource;
+    core::ImageState src;
+    core::ImageState dst;
+  };
+
+  uint32_t resourceIndex(const std::string &name);
+  uint32_t findOrAddResource(const std::string &name);
+
+  void sortPasses();
+  void createTransients(VkExtent2D extent);
+  void computeBarriers();
+  void flushBarriers(VkCommandBuffer cmd, const Vector<Barrier> &barriers);
+  void releaseTransients(core::DeletionQueue *retired = nullptr);
+
+  Pointer<core::Device> _device;
+  Pointer<GpuProfiler> _profiler;
+
+  Vector<Pointer<RenderPass>> _passes;
+  Vector<uint32_t> _order;
+
+  Vector<Resource> _resources;
+  std::unordered_map<std::string, uint32_t> _resourceIds;
+  Vector<MemorySlot> _slots;
+  VkDeviceSize _transientMemory = 0;
+
+  Vector<Vector<Barrier>> _passBarriers;
+  Vector<Barrier> _finalBarriers;
+  Vector<VkImageMemoryBarrier2> _imageBarriers;
 };
 
 } // namespace rendering
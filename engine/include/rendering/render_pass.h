@@ -1,10 +1,17 @@
 #pragma once
 
 #include "pch.h"
+#include <functional>
+#include <string>
 
 namespace bisky {
 namespace rendering {
 
+class RenderGraph;
+
+/**
+ * Describes an image owned by the render graph. Sizes are relative to the extent the graph is compiled with.
+ */
 struct AttachmentInfo {
   std::string name;
   float size_x = 1.0f;
@@ -16,19 +23,60 @@ struct AttachmentInfo {
   bool persistent = false;
 };
 
+enum class AttachmentUsage {
+  COLOR_OUTPUT,
+  DEPTH_OUTPUT,
+  STORAGE_OUTPUT,
+  ATTACHMENT_INPUT,
+  TRANSFER_INPUT,
+  TRANSFER_OUTPUT,
+};
+
+struct AttachmentAccess {
+  std::string name;
+  AttachmentUsage usage;
+};
+
+/**
+ * A node of the render graph. Declares which attachments it reads and writes, the graph derives the barriers in
+ * between from that. Outputs given a format create a transient attachment, otherwise they refer to an imported image
+ * or to an attachment created by another pass.
+ */
 class RenderPass {
 public:
-  RenderPass();
+  using ExecuteFunction = std::function<void(VkCommandBuffer, RenderGraph &)>;
+
+  RenderPass(std::string name, VkPipelineStageFlags2 stages);
   ~RenderPass();
 
-  void addColorOutput(std::string name, AttachmentInfo attachment);
+  void addColorOutput(std::string name, AttachmentInfo attachment = {});
+  void addDepthOutput(std::string name, AttachmentInfo attachment = {});
+  void addStorageOutput(std::string name, AttachmentInfo attachment = {});
+  void addTransferOutput(std::string name, AttachmentInfo attachment = {});
+
+  // attachment inputs are sampled by the shader stages of the pass
   void addAttachmentInput(std::string name);
+  void addTransferInput(std::string name);
+
+  void setExecute(ExecuteFunction execute) { _execute = std::move(execute); }
+  void execute(VkCommandBuffer cmd, RenderGraph &graph);
 
+  const std::string &name() const { return _name; }
+  VkPipelineStageFlags2 stages() const { return _stages; }
+  const Vector<AttachmentAccess> &accesses() const { return _accesses; }
   Vector<AttachmentInfo> attachments() { return _outputs; }
 
 private:
+  void addOutput(std::string name, AttachmentUsage usage, AttachmentInfo attachment);
+  void addInput(std::string name, AttachmentUsage usage);
+
+  std::string _name;
+  VkPipelineStageFlags2 _stages;
+  ExecuteFunction _execute;
+
   Vector<AttachmentInfo> _outputs;
   Vector<std::string> _inputs;
+  Vector<AttachmentAccess> _accesses;
 };
 
 } // namespace rendering
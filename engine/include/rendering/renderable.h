@@ -1,5 +1,6 @@
 #pragma once
 
+#include "core/mesh_loader.h"
 #include "gpu/gpu_object.h"
 #include "pch.h"
 
@@ -11,8 +12,23 @@ struct RenderContext {
 };
 
 class IRenderable {
+public:
   virtual void draw(const glm::mat4 &topMatrix, RenderContext &ctx) = 0;
 };
 
+/**
+ * Emits one GPUObject per surface of a mesh, all sharing the node's material and transform.
+ */
+class MeshNode : public IRenderable {
+public:
+  MeshNode(Pointer<MeshAsset> mesh, Pointer<MaterialInstance> material, glm::mat4 transform = glm::mat4(1.0f));
+
+  virtual void draw(const glm::mat4 &topMatrix, RenderContext &ctx) override;
+
+  Pointer<MeshAsset> mesh;
+  Pointer<MaterialInstance> material;
+  glm::mat4 transform;
+};
+
 } // namespace rendering
 } // namespace bisky
@@ -1,19 +1,35 @@
 #pragma once
 
+#include "core/bindless_descriptors.h"
 #include "core/compute_pipeline.h"
 #include "core/deletion_queue.h"
+#include "core/descriptor_cache.h"
 #include "core/descriptor_allocator_growable.h"
 #include "core/descriptor_writer.h"
 #include "core/descriptors.h"
 #include "core/device.h"
+#include "core/image_state_tracker.h"
 #include "core/immedate_submit.h"
 #include "core/mesh_loader.h"
+#include "core/thread_pool.h"
 #include "core/model.h"
 #include "core/window.h"
 #include "gpu/gpu_mesh_buffers.h"
 #include "gpu/gpu_scene_data.h"
 #include "pch.h"
 #include "rendering/frame_data.h"
+#include "rendering/frame_pacer.h"
+#include "rendering/frustum_culler.h"
+#include "rendering/depth_pyramid.h"
+#include "rendering/draw_list.h"
+#include "rendering/gpu_profiler.h"
+#include "rendering/indirect_drawer.h"
+#include "rendering/light_culler.h"
+#include "rendering/lod_selector.h"
+#include "rendering/render_graph.h"
+#include "rendering/renderable.h"
+#include "rendering/resolution_scaler.h"
+#include <span>
 
 namespace bisky {
 
@@ -26,22 +42,38 @@ class Device;
 
 namespace rendering {
 
-constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+// view depth range of the camera, reversed in the projection
+constexpr float NEAR_PLANE = 0.1f;
+constexpr float FAR_PLANE = 100.0f;
+
+struct RendererSettings {
+  // two or three frames keep the GPU busy, one frame has the lowest latency but serializes CPU and GPU
+  uint32_t framesInFlight = 2;
+  // falls back to FIFO when the surface does not support it
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+  // how many of the frames in flight the pacer lets the CPU queue, 0 allows all of them
+  uint32_t queuedFrames = 0;
+  // adjusts the render scale from the measured gpu frame time when enabled
+  ResolutionScaler::Settings resolution = {};
+};
 
 class Renderer {
 public:
-  Renderer(Pointer<core::Window> window, Pointer<core::Device> device, VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+  Renderer(Pointer<core::Window> window, Pointer<core::Device> device, RendererSettings settings = {},
+           VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+  // headless, frames are rendered into offscreen images and read back instead of presented
+  Renderer(Pointer<core::Device> device, VkExtent2D extent, RendererSettings settings = {});
   ~Renderer();
 
   void cleanup();
 
   VkCommandBuffer beginRenderPass();
   void endRenderPass(VkCommandBuffer commandBuffer);
-  void clear(VkCommandBuffer commandBuffer, uint32_t imageIndex);
-  void draw(VkCommandBuffer commandBuffer, ComputeEffect &effect, VkPipelineLayout layout, VkPipeline graphicsPipeline,
-            Vector<Pointer<MeshAsset>> meshes, uint32_t imageIndex);
-  void drawGeometry(VkCommandBuffer commandBuffer, VkPipelineLayout layout, VkPipeline pipeline,
-                    Vector<Pointer<MeshAsset>> meshes);
+  void draw(VkCommandBuffer commandBuffer, ComputeEffect &effect, const RenderContext &context, uint32_t imageIndex);
+  void drawBackground(VkCommandBuffer commandBuffer, ComputeEffect &effect);
+  void drawGeometry(VkCommandBuffer commandBuffer, const RenderContext &context);
+  void drawLateGeometry(VkCommandBuffer commandBuffer);
   void drawImgui(VkCommandBuffer commandBuffer, VkImageView target);
   void setViewportAndScissor(VkCommandBuffer commandBuffer, VkViewport viewport, VkRect2D scissor);
   bool acquireNextImage(uint32_t *imageIndex);
@@ -49,7 +81,20 @@ public:
 
   void waitForFence();
   void resetFence();
-
+  // blocks until the pacer allows another frame to be queued, call before sampling input
+  void pace();
+
+  // waits for the last submitted frame and returns its pixels as tightly packed RGBA8 rows
+  std::span<const uint8_t> readFrame();
+  // paths ending in .png are encoded, anything else gets the raw pixels
+  void writeFrame(const std::string &path);
+
+  bool headless() { return _window == nullptr; }
+  uint32_t framesInFlight() { return static_cast<uint32_t>(_frames.size()); }
+  VkPresentModeKHR presentMode() { return _presentMode; }
+  // takes effect when the swapchain is recreated before the next frame
+  void setPresentMode(VkPresentModeKHR presentMode);
+  FramePacer &framePacer() { return _framePacer; }
   VkSwapchainKHR swapchain() { return _swapchain; }
   VkRenderPass renderPass() { return _renderPass; }
   const VkFormat &format() { return _format; }
@@ -62,16 +107,32 @@ public:
   VkImage currentImage() { return _images[_currentFrame]; }
   FrameData &getCurrentFrame() { return _frames[_currentFrame]; }
   const VkDescriptorSetLayout &drawImageLayout() { return _drawImageDescriptorLayout; }
-  const VkDescriptorSet &drawImageDescriptors() { return _drawImageDescriptors; }
-  const AllocatedImage &drawImage() { return _drawImage; }
-  const AllocatedImage &depthImage() { return _depthImage; }
+  const VkDescriptorSet &drawImageDescriptors() { return getCurrentFrame().drawImageDescriptors; }
+  const AllocatedImage &drawImage() { return getCurrentFrame().drawImage; }
+  VkFormat depthFormat() { return _depthFormat; }
   Pointer<core::ImmediateSubmit> immediateSubmit() { return _immediateSubmit; }
+  Pointer<core::DescriptorCache> descriptorCache() { return _descriptorCache; }
   float &renderScale() { return _renderScale; }
-  VkDescriptorSetLayout &singleImageLayout() { return _singleImageDescriptorLayout; }
+  ResolutionScaler &resolutionScaler() { return _resolutionScaler; }
+  VkDescriptorSetLayout bindlessLayout() { return _bindless.layout(); }
+  const AllocatedImage &errorImage() { return _errorCheckerboardImage; }
+  uint32_t nearestSampler() { return _nearestSamplerIndex; }
+  uint32_t linearSampler() { return _linearSamplerIndex; }
+  VkDescriptorSetLayout &sceneDataLayout() { return _gpuSceneDescriptorLayout; }
+  void setIndirectDrawer(Pointer<IndirectDrawer> indirectDrawer) { _indirectDrawer = indirectDrawer; }
+  void setDepthPyramid(Pointer<DepthPyramid> depthPyramid);
+  void setLightCuller(Pointer<LightCuller> lightCuller) { _lightCuller = lightCuller; }
+  bool &gpuDriven() { return _gpuDriven; }
+  const DrawList::Stats &drawStats() { return _drawStats; }
+  uint32_t visibleObjects() { return static_cast<uint32_t>(_culler.visible().size()); }
+  LodSelector &lodSelector() { return _lodSelector; }
+  GpuProfiler &gpuProfiler() { return *_gpuProfiler; }
 
   AllocatedImage createImage(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
   AllocatedImage createImage(void *data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage,
                              bool mipmapped = false);
+  void destroyImage(const AllocatedImage &image);
+  core::ImageStateTracker &imageStates() { return _imageStates; }
 
 private:
   void initialize();
@@ -79,13 +140,25 @@ private:
   void initializeImgui();
   void createSwapchain();
   void createImageViews();
+  void createOffscreenImages();
+  void createDrawImages();
+  void createDrawImage(AllocatedImage &drawImage);
+  void resizeDrawImage(FrameData &frame);
   // void createRenderPass();
   // void createDepthResources();
   // void createFramebuffers();
   void initializeCommands();
   void initializeSyncStructures();
   void initializeDescriptors();
+  void initializeFrameUniforms();
+  void initializeRenderGraph();
   void recreate();
+  void updateSceneData();
+  // of this frame's scene data in its uniform ring, once it was pushed
+  VkDeviceAddress sceneDataAddress() { return getCurrentFrame().uniformRing.deviceAddress() + _sceneDataOffset; }
+  void submitCompute(ComputeEffect &effect);
+  void updateRenderScale();
+  void waitForFrame(uint32_t frame);
 
   VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats);
   VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes);
@@ -94,15 +167,24 @@ private:
   Pointer<core::Window> _window;
   Pointer<core::Device> _device;
   Pointer<core::ImmediateSubmit> _immediateSubmit;
+  Pointer<core::DescriptorCache> _descriptorCache;
+  RendererSettings _settings;
 
   VkSwapchainKHR _swapchain;
   VkSwapchainKHR _oldSwapchain;
+  // swapchains replaced by recreate, their presents are only known to be done after one from the new swapchain
+  core::DeletionQueue _retiredSwapchains;
   VkRenderPass _renderPass;
   Vector<VkImage> _images;
   Vector<VkImageView> _imageViews;
   Vector<VkFramebuffer> _framebuffers;
   VkFormat _format;
   VkExtent2D _extent;
+  VkPresentModeKHR _presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+  // headless targets standing in for the swapchain images, one per frame
+  Vector<AllocatedImage> _offscreenImages;
+  Vector<GPUBuffer> _readbackBuffers;
 
   AllocatedImage _whiteImage;
   AllocatedImage _blackImage;
@@ -111,25 +193,50 @@ private:
 
   VkSampler _defaultSamplerLinear;
   VkSampler _defaultSamplerNearest;
+  uint32_t _linearSamplerIndex = 0;
+  uint32_t _nearestSamplerIndex = 0;
+
+  core::ImageStateTracker _imageStates;
 
   core::DescriptorAllocator _globalDescriptorAllocator;
   core::DescriptorWriter _writer = {};
 
-  VkDescriptorSet _drawImageDescriptors;
   VkDescriptorSetLayout _drawImageDescriptorLayout;
-  AllocatedImage _drawImage;
-  AllocatedImage _depthImage;
+  VkFormat _depthFormat = VK_FORMAT_D32_SFLOAT;
   VkExtent2D _drawExtent;
   float _renderScale = 1.0f;
-
-  GPUSceneData _sceneData;
+  ResolutionScaler _resolutionScaler;
+  uint32_t _scaledFrames = 0;
+
+  GPUSceneData _sceneData = {};
+  uint32_t _sceneDataOffset = 0;
+  glm::vec3 _cameraPosition;
+  // pixels per unit at distance one, for projecting lod errors
+  float _projectionScale = 1.0f;
+  core::DescriptorAllocator _frameUniformAllocator;
+  Pointer<IndirectDrawer> _indirectDrawer;
+  Pointer<DepthPyramid> _depthPyramid;
+  Pointer<LightCuller> _lightCuller;
+  bool _gpuDriven = true;
+  FrustumCuller _culler;
+  LodSelector _lodSelector;
+  DrawList _drawList;
+  DrawList::Stats _drawStats = {};
+  Pointer<core::ThreadPool> _workers;
+  Pointer<RenderGraph> _renderGraph;
+  Pointer<GpuProfiler> _gpuProfiler;
+  ComputeEffect *_backgroundEffect = nullptr;
+  const RenderContext *_renderContext = nullptr;
   VkDescriptorSetLayout _gpuSceneDescriptorLayout;
-  VkDescriptorSetLayout _singleImageDescriptorLayout;
+  // every sampled image created through createImage, bound as set 0 of the mesh pipelines
+  core::BindlessDescriptors _bindless;
 
   VkDescriptorPool _imguiPool;
 
-  FrameData _frames[FRAME_OVERLAP];
+  Vector<FrameData> _frames;
   uint32_t _currentFrame = 0;
+  uint32_t _lastSubmittedFrame = 0;
+  FramePacer _framePacer;
   bool _framebufferResized = false;
 
   core::DeletionQueue _deletionQueue;
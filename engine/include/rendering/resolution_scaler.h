@@ -0,0 +1,41 @@
+#pragma once
+
+#include "pch.h"
+
+namespace bisky {
+namespace rendering {
+
+/**
+ * Picks the render scale that holds the GPU frame time at a target. The measured time is smoothed, the scale only
+ * drops above the target and only rises once the frame is comfortably below it, so it does not oscillate around the
+ * target. GPU cost is assumed to follow the pixel count, the square of the scale.
+ *
+ * timings arrive frames in flight late, after a change the scaler waits that long before it judges the new scale.
+ */
+class ResolutionScaler {
+public:
+  struct Settings {
+    bool enabled = false;
+    float targetFrameTime = 1000.0f / 60.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+  };
+
+  explicit ResolutionScaler(Settings settings = {}, uint32_t latency = 2);
+
+  // takes the gpu milliseconds of a completed frame and returns the scale for the next one
+  float update(float frameTime, float scale);
+
+  Settings &settings() { return _settings; }
+  float smoothedFrameTime() const { return _smoothedFrameTime; }
+
+private:
+  Settings _settings;
+  uint32_t _latency;
+
+  float _smoothedFrameTime = 0.0f;
+  uint32_t _cooldown = 0;
+};
+
+} // namespace rendering
+} // namespace bisky
@@ -1,10 +1,12 @@
 #pragma once
 
+#include "core/cpu_profiler.h"
 #include "core/device.h"
 #include "core/immedate_submit.h"
 #include "gpu/gpu_mesh_buffers.h"
 #include "pch.h"
 #include "utils/init.h"
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <slang-com-ptr.h>
@@ -30,6 +32,21 @@ inline bool hasStencilComponent(VkFormat format) {
   return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
+inline VkImageAspectFlags aspectMask(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_D16_UNORM:
+  case VK_FORMAT_X8_D24_UNORM_PACK32:
+  case VK_FORMAT_D32_SFLOAT:
+    return VK_IMAGE_ASPECT_DEPTH_BIT;
+  case VK_FORMAT_D16_UNORM_S8_UINT:
+  case VK_FORMAT_D24_UNORM_S8_UINT:
+  case VK_FORMAT_D32_SFLOAT_S8_UINT:
+    return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+  default:
+    return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
 inline bool checkValidationLayerSupport() {
   uint32_t layerCount;
   vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
@@ -55,12 +72,16 @@ inline bool checkValidationLayerSupport() {
   return true;
 }
 
-inline std::vector<const char *> getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+inline std::vector<const char *> getRequiredExtensions(bool headless = false) {
+  std::vector<const char *> extensions;
 
-  std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  // headless instances have no surface and never initialize glfw
+  if (!headless) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
 #if __APPLE__
   extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
@@ -115,33 +136,50 @@ inline void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT
   createInfo.pfnUserCallback = debugCallback;
 }
 
-inline void transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout) {
-  VkImageMemoryBarrier2 imageBarrier{.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
-  imageBarrier.pNext = nullptr;
+inline void bufferBarrier(VkCommandBuffer cmd, VkBuffer buffer, VkPipelineStageFlags2 srcStage,
+                          VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess) {
+  VkBufferMemoryBarrier2 bufferBarrier{.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2};
+  bufferBarrier.pNext = nullptr;
 
-  imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-  imageBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
-  imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-  imageBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;
+  bufferBarrier.srcStageMask = srcStage;
+  bufferBarrier.srcAccessMask = srcAccess;
+  bufferBarrier.dstStageMask = dstStage;
+  bufferBarrier.dstAccessMask = dstAccess;
 
-  imageBarrier.oldLayout = currentLayout;
-  imageBarrier.newLayout = newLayout;
-
-  VkImageAspectFlags aspectMask =
-      (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
-  imageBarrier.subresourceRange = init::imageSubresourceRange(aspectMask);
-  imageBarrier.image = image;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.buffer = buffer;
+  bufferBarrier.offset = 0;
+  bufferBarrier.size = VK_WHOLE_SIZE;
 
   VkDependencyInfo depInfo{};
   depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
   depInfo.pNext = nullptr;
 
-  depInfo.imageMemoryBarrierCount = 1;
-  depInfo.pImageMemoryBarriers = &imageBarrier;
+  depInfo.bufferMemoryBarrierCount = 1;
+  depInfo.pBufferMemoryBarriers = &bufferBarrier;
 
   vkCmdPipelineBarrier2(cmd, &depInfo);
 }
 
+/**
+ * Extracts the six normalized frustum planes (left, right, bottom, top, near, far) from a view projection matrix.
+ * Planes point inwards, so a point p is inside when dot(plane.xyz, p) + plane.w >= 0.
+ */
+inline std::array<glm::vec4, 6> extractFrustumPlanes(const glm::mat4 &viewproj) {
+  glm::mat4 m = glm::transpose(viewproj);
+
+  std::array<glm::vec4, 6> planes = {
+      m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[2], m[3] - m[2],
+  };
+
+  for (glm::vec4 &plane : planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+
+  return planes;
+}
+
 inline void copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage destination, VkExtent2D srcSize,
                              VkExtent2D dstSize) {
   VkImageBlit2 blitRegion = {};
@@ -179,6 +217,7 @@ inline void copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage destin
 }
 
 inline bool loadShaderModule(const char *filePath, VkDevice device, VkShaderModule *outModule) {
+  BISKY_PROFILE_ZONE("utils::loadShaderModule");
   std::ifstream file(filePath, std::ios::ate | std::ios::binary);
 
   if (!file.is_open()) {
@@ -207,6 +246,7 @@ inline bool loadShaderModule(const char *filePath, VkDevice device, VkShaderModu
 
 inline bool loadShaderModule(Slang::ComPtr<slang::ISession> session, slang::IModule *module, VkDevice device,
                              const char *entryPoint, VkShaderModule *outModule) {
+  BISKY_PROFILE_ZONE("utils::loadShaderModule");
   Slang::ComPtr<slang::IEntryPoint> stageEntryPoint;
   module->findEntryPointByName(entryPoint, stageEntryPoint.writeRef());
 
@@ -258,6 +298,7 @@ inline bool loadShaderModule(Slang::ComPtr<slang::ISession> session, slang::IMod
 }
 
 inline slang::IModule *createSlangModule(Slang::ComPtr<slang::ISession> session, const char *file) {
+  BISKY_PROFILE_ZONE("utils::createSlangModule");
   slang::IModule *module;
   Slang::ComPtr<slang::IBlob> diagnosticsBlob;
   module = session->loadModule(file, diagnosticsBlob.writeRef());
@@ -270,48 +311,79 @@ inline slang::IModule *createSlangModule(Slang::ComPtr<slang::ISession> session,
 }
 
 inline GPUMeshBuffers uploadMesh(Pointer<core::Device> device, Pointer<core::ImmediateSubmit> immediateSubmit,
-                                 std::span<uint32_t> indices, std::span<Vertex> vertices) {
-  const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
-  const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
+                                 std::span<uint32_t> indices, std::span<Vertex> vertices,
+                                 std::span<const CompactVertex> compactVertices) {
   GPUMeshBuffers buffers;
+  // halves the index bandwidth when every vertex is addressable with 16 bits, 0xffff stays free for primitive restart
+  buffers.indexType = vertices.size() < UINT16_MAX ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+  const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
+  const size_t indexSize = buffers.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+  const size_t indexBufferSize = indices.size() * indexSize;
+  const size_t compactVertexBufferSize = compactVertices.size() * sizeof(CompactVertex);
 
   GPUBuffer::Builder builder = {};
   buffers.vertexBuffer = builder.build(device->allocator(), vertexBufferSize,
                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
                                            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
                                        VMA_MEMORY_USAGE_GPU_ONLY);
+  buffers.compactVertexBuffer = builder.build(device->allocator(), compactVertexBufferSize,
+                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                                  VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                              VMA_MEMORY_USAGE_GPU_ONLY);
 
   VkBufferDeviceAddressInfo deviceAddressInfo = {};
   deviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
   deviceAddressInfo.buffer = buffers.vertexBuffer.buffer;
   buffers.vertexBufferAddress = vkGetBufferDeviceAddress(device->device(), &deviceAddressInfo);
+  deviceAddressInfo.buffer = buffers.compactVertexBuffer.buffer;
+  buffers.compactVertexBufferAddress = vkGetBufferDeviceAddress(device->device(), &deviceAddressInfo);
 
   buffers.indexBuffer =
       builder.build(device->allocator(), indexBufferSize,
                     VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
 
-  GPUBuffer staging = builder.build(device->allocator(), vertexBufferSize + indexBufferSize,
+  GPUBuffer staging = builder.build(device->allocator(), vertexBufferSize + indexBufferSize + compactVertexBufferSize,
                                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
 
   void *data = staging.info.pMappedData;
   memcpy(data, vertices.data(), vertexBufferSize);
-  memcpy((char *)data + vertexBufferSize, indices.data(), indexBufferSize);
-
-  immediateSubmit->submit([&](VkCommandBuffer cmd) {
-    VkBufferCopy vertexCopy = {};
-    vertexCopy.size = vertexBufferSize;
-    vertexCopy.srcOffset = 0;
-    vertexCopy.dstOffset = 0;
-    vkCmdCopyBuffer(cmd, staging.buffer, buffers.vertexBuffer.buffer, 1, &vertexCopy);
-
-    VkBufferCopy indexCopy = {};
-    indexCopy.size = indexBufferSize;
-    indexCopy.srcOffset = vertexBufferSize;
-    indexCopy.dstOffset = 0;
-    vkCmdCopyBuffer(cmd, staging.buffer, buffers.indexBuffer.buffer, 1, &indexCopy);
-  });
-
-  staging.cleanup(device->allocator());
+  if (buffers.indexType == VK_INDEX_TYPE_UINT16) {
+    uint16_t *shortIndices = reinterpret_cast<uint16_t *>((char *)data + vertexBufferSize);
+    std::copy(indices.begin(), indices.end(), shortIndices);
+  } else {
+    memcpy((char *)data + vertexBufferSize, indices.data(), indexBufferSize);
+  }
+  memcpy((char *)data + vertexBufferSize + indexBufferSize, compactVertices.data(), compactVertexBufferSize);
+
+  // vertices are pulled through their device address, indices by the input assembler
+  const core::ImmediateSubmit::BufferUpload uploads[] = {
+      {buffers.vertexBuffer.buffer, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT},
+      {buffers.indexBuffer.buffer, VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT},
+      {buffers.compactVertexBuffer.buffer, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT},
+  };
+
+  immediateSubmit->upload(
+      [&](VkCommandBuffer cmd) {
+        VkBufferCopy vertexCopy = {};
+        vertexCopy.size = vertexBufferSize;
+        vertexCopy.srcOffset = 0;
+        vertexCopy.dstOffset = 0;
+        vkCmdCopyBuffer(cmd, staging.buffer, buffers.vertexBuffer.buffer, 1, &vertexCopy);
+
+        VkBufferCopy indexCopy = {};
+        indexCopy.size = indexBufferSize;
+        indexCopy.srcOffset = vertexBufferSize;
+        indexCopy.dstOffset = 0;
+        vkCmdCopyBuffer(cmd, staging.buffer, buffers.indexBuffer.buffer, 1, &indexCopy);
+
+        VkBufferCopy compactVertexCopy = {};
+        compactVertexCopy.size = compactVertexBufferSize;
+        compactVertexCopy.srcOffset = vertexBufferSize + indexBufferSize;
+        compactVertexCopy.dstOffset = 0;
+        vkCmdCopyBuffer(cmd, staging.buffer, buffers.compactVertexBuffer.buffer, 1, &compactVertexCopy);
+      },
+      uploads, {}, [allocator = device->allocator(), staging]() mutable { staging.cleanup(allocator); });
 
   return buffers;
 }
@@ -42,6 +42,13 @@ template <typename T> using Pointer = std::shared_ptr<T>;
 struct QueueFamilyIndices {
   std::optional<uint32_t> queueFamily;
 
+  // unset when compute has to share the graphics queue
+  std::optional<uint32_t> computeFamily;
+  uint32_t computeQueueIndex = 0;
+
+  // unset when uploads have to share the graphics queue
+  std::optional<uint32_t> transferFamily;
+
   bool isComplete() { return queueFamily.has_value(); }
 };
 
@@ -53,11 +60,31 @@ struct Vertex {
   glm::vec4 color;
 };
 
+// a quarter of Vertex, positions are dequantized with the VertexQuantization of their mesh
+struct CompactVertex {
+  // x and y as unorm16
+  uint32_t positionXY;
+  // z as unorm16, then the octahedral encoded normal as two snorm8
+  uint32_t positionZNormal;
+  // two half floats
+  uint32_t uv;
+  // rgba as unorm8
+  uint32_t color;
+};
+
 struct GPUPushConstants {
-  glm::mat4 worldMatrix;
+  VkDeviceAddress instanceBuffer;
   VkDeviceAddress vertexBuffer;
 };
 
+struct GPUInstanceData {
+  glm::mat4 worldMatrix;
+  // into the bindless texture and sampler arrays
+  uint32_t textureIndex;
+  uint32_t samplerIndex;
+  uint32_t padding[2];
+};
+
 struct ComputePushConstants {
   glm::vec4 data1;
   glm::vec4 data2;
@@ -78,6 +105,8 @@ struct AllocatedImage {
   VmaAllocation allocation;
   VkExtent3D extent;
   VkFormat format;
+  // slot in the bindless texture array, for sampled images created by the renderer
+  uint32_t textureIndex = UINT32_MAX;
 
   inline void cleanup(VkDevice device, VmaAllocator allocator) {
     vkDestroyImageView(device, imageView, nullptr);
@@ -85,8 +114,6 @@ struct AllocatedImage {
   }
 };
 
-constexpr uint32_t FRAME_OVERLAP = 2;
-
 struct SwapchainSupportDetails {
   VkSurfaceCapabilitiesKHR capabilities;
   std::vector<VkSurfaceFormatKHR> formats;
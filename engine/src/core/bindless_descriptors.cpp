@@ -0,0 +1,94 @@
+#include "core/bindless_descriptors.h"
+#include "core/descriptor_writer.h"
+#include "core/descriptors.h"
+
+namespace bisky {
+namespace core {
+
+void BindlessDescriptors::init(VkDevice device) {
+  const VkDescriptorBindingFlags bindingFlags[] = {
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+  };
+
+  VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+  bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+  bindingFlagsInfo.bindingCount = 2;
+  bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+  DescriptorLayoutBuilder builder;
+  _layout = builder.add(TEXTURE_BINDING, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MAX_TEXTURES)
+                .add(SAMPLER_BINDING, VK_DESCRIPTOR_TYPE_SAMPLER, MAX_SAMPLERS)
+                .build(device, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, &bindingFlagsInfo,
+                       VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+
+  const VkDescriptorPoolSize poolSizes[] = {
+      {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MAX_TEXTURES},
+      {VK_DESCRIPTOR_TYPE_SAMPLER, MAX_SAMPLERS},
+  };
+
+  VkDescriptorPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes = poolSizes;
+  VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &_pool));
+
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = _pool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &_layout;
+  VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &_set));
+}
+
+void BindlessDescriptors::cleanup(VkDevice device) {
+  vkDestroyDescriptorPool(device, _pool, nullptr);
+  vkDestroyDescriptorSetLayout(device, _layout, nullptr);
+  _textureCount = 0;
+  _samplerCount = 0;
+  _freeTextures.clear();
+}
+
+uint32_t BindlessDescriptors::addTexture(VkDevice device, VkImageView view) {
+  uint32_t index = _textureCount;
+  if (!_freeTextures.empty()) {
+    index = _freeTextures.back();
+    _freeTextures.pop_back();
+  } else if (_textureCount == MAX_TEXTURES) {
+    throw std::runtime_error("bindless texture array is full");
+  } else {
+    _textureCount++;
+  }
+
+  DescriptorWriter writer;
+  writer.writeImage(TEXTURE_BINDING, view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, index);
+  writer.updateSet(device, _set);
+
+  return index;
+}
+
+void BindlessDescriptors::removeTexture(uint32_t index, DeletionQueue &retired) {
+  // command buffers still in flight may sample the slot
+  retired.push_back([this, index]() { _freeTextures.push_back(index); });
+}
+
+uint32_t BindlessDescriptors::addSampler(VkDevice device, VkSampler sampler) {
+  if (_samplerCount == MAX_SAMPLERS) {
+    throw std::runtime_error("bindless sampler array is full");
+  }
+
+  DescriptorWriter writer;
+  writer.writeImage(SAMPLER_BINDING, VK_NULL_HANDLE, sampler, VK_IMAGE_LAYOUT_UNDEFINED, VK_DESCRIPTOR_TYPE_SAMPLER,
+                    _samplerCount);
+  writer.updateSet(device, _set);
+
+  return _samplerCount++;
+}
+
+} // namespace core
+} // namespace bisky
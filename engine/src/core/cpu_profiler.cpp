@@ -0,0 +1,134 @@
+#include "core/cpu_profiler.h"
+
+#include <algorithm>
+
+namespace bisky {
+namespace core {
+
+namespace {
+
+// the buffers are only created once a thread records while enabled, naming a thread is free until then
+thread_local CpuProfiler *t_profiler = nullptr;
+thread_local void *t_buffer = nullptr;
+thread_local const char *t_name = nullptr;
+
+} // namespace
+
+CpuProfiler &CpuProfiler::get() {
+  static CpuProfiler profiler;
+  return profiler;
+}
+
+void CpuProfiler::zone(const char *name, uint64_t start, uint64_t end) {
+  Event event = {};
+  event.name = name;
+  event.start = start;
+  event.duration = end - start;
+  event.type = EventType::ZONE;
+  push(event);
+}
+
+void CpuProfiler::counter(const char *name, double value) {
+  Event event = {};
+  event.name = name;
+  event.start = now();
+  event.value = value;
+  event.type = EventType::COUNTER;
+  push(event);
+}
+
+void CpuProfiler::frame() {
+  Event event = {};
+  event.name = "frame";
+  event.start = now();
+  event.type = EventType::FRAME;
+  push(event);
+}
+
+void CpuProfiler::setThreadName(const char *name) {
+  t_name = name;
+  if (t_profiler == this) {
+    static_cast<ThreadBuffer *>(t_buffer)->name = name;
+  }
+}
+
+CpuProfiler::ThreadBuffer &CpuProfiler::threadBuffer() {
+  if (t_profiler != this) {
+    std::lock_guard<std::mutex> lock(_threadsMutex);
+    _threads.push_back(std::make_unique<ThreadBuffer>());
+    _threads.back()->id = static_cast<uint32_t>(_threads.size() - 1);
+    _threads.back()->name = t_name;
+
+    t_profiler = this;
+    t_buffer = _threads.back().get();
+  }
+
+  return *static_cast<ThreadBuffer *>(t_buffer);
+}
+
+void CpuProfiler::push(const Event &event) {
+  ThreadBuffer &buffer = threadBuffer();
+
+  // single producer, the release makes the event visible to writeChromeTrace before the new head
+  const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+  buffer.events[head % EVENTS_PER_THREAD] = event;
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void CpuProfiler::writeChromeTrace(const std::string &path) {
+  std::ofstream file(path);
+  if (!file) {
+    throw std::runtime_error("failed to open " + path);
+  }
+
+  std::lock_guard<std::mutex> lock(_threadsMutex);
+
+  bool first = true;
+  auto separator = [&]() {
+    const char *s = first ? "\n" : ",\n";
+    first = false;
+    return s;
+  };
+
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for (const std::unique_ptr<ThreadBuffer> &thread : _threads) {
+    if (thread->name) {
+      file << separator()
+           << fmt::format("{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": {}, "
+                          "\"args\": {{\"name\": \"{}\"}}}}",
+                          thread->id, thread->name);
+    }
+
+    const uint64_t head = thread->head.load(std::memory_order_acquire);
+    const uint64_t count = std::min<uint64_t>(head, EVENTS_PER_THREAD);
+    for (uint64_t i = head - count; i < head; i++) {
+      const Event &event = thread->events[i % EVENTS_PER_THREAD];
+      const double ts = event.start / 1000.0;
+
+      switch (event.type) {
+      case EventType::ZONE:
+        file << separator()
+             << fmt::format("{{\"name\": \"{}\", \"ph\": \"X\", \"pid\": 0, \"tid\": {}, \"ts\": {:.3f}, "
+                            "\"dur\": {:.3f}}}",
+                            event.name, thread->id, ts, event.duration / 1000.0);
+        break;
+      case EventType::COUNTER:
+        file << separator()
+             << fmt::format("{{\"name\": \"{}\", \"ph\": \"C\", \"pid\": 0, \"tid\": {}, \"ts\": {:.3f}, "
+                            "\"args\": {{\"value\": {}}}}}",
+                            event.name, thread->id, ts, event.value);
+        break;
+      case EventType::FRAME:
+        file << separator()
+             << fmt::format("{{\"name\": \"{}\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 0, \"tid\": {}, "
+                            "\"ts\": {:.3f}}}",
+                            event.name, thread->id, ts);
+        break;
+      }
+    }
+  }
+  file << "\n]}\n";
+}
+
+} // namespace core
+} // namespace bisky
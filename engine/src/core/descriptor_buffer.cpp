@@ -0,0 +1,65 @@
+#include "core/descriptor_buffer.h"
+#include "core/device.h"
+
+namespace bisky {
+namespace core {
+
+namespace {
+
+constexpr VkDeviceSize UNKNOWN_OFFSET = UINT64_MAX;
+
+} // namespace
+
+void DescriptorBuffer::init(Pointer<Device> device, size_t size) {
+  _device = device;
+  _ring.init(_device->device(), _device->allocator(), size,
+             _device->descriptorBufferProperties().descriptorBufferOffsetAlignment,
+             VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+}
+
+void DescriptorBuffer::cleanup() {
+  _ring.cleanup(_device->allocator());
+  _layouts.clear();
+}
+
+GPURingBuffer::Allocation DescriptorBuffer::allocate(VkDescriptorSetLayout layout) {
+  return _ring.allocate(layoutInfo(layout).size);
+}
+
+VkDeviceSize DescriptorBuffer::bindingOffset(VkDescriptorSetLayout layout, uint32_t binding) {
+  Vector<VkDeviceSize> &offsets = layoutInfo(layout).bindingOffsets;
+  if (binding >= offsets.size()) {
+    offsets.resize(binding + 1, UNKNOWN_OFFSET);
+  }
+
+  if (offsets[binding] == UNKNOWN_OFFSET) {
+    _device->descriptorBufferFunctions().getBindingOffset(_device->device(), layout, binding, &offsets[binding]);
+  }
+  return offsets[binding];
+}
+
+void DescriptorBuffer::bind(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout,
+                            uint32_t set, uint32_t offset) {
+  const DescriptorBufferFunctions &functions = _device->descriptorBufferFunctions();
+
+  VkDescriptorBufferBindingInfoEXT bindingInfo = {};
+  bindingInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+  bindingInfo.address = _ring.deviceAddress();
+  bindingInfo.usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+  functions.bindBuffers(cmd, 1, &bindingInfo);
+
+  const uint32_t bufferIndex = 0;
+  const VkDeviceSize bufferOffset = offset;
+  functions.setOffsets(cmd, bindPoint, pipelineLayout, set, 1, &bufferIndex, &bufferOffset);
+}
+
+DescriptorBuffer::LayoutInfo &DescriptorBuffer::layoutInfo(VkDescriptorSetLayout layout) {
+  auto [it, inserted] = _layouts.try_emplace(layout);
+  if (inserted) {
+    _device->descriptorBufferFunctions().getLayoutSize(_device->device(), layout, &it->second.size);
+  }
+  return it->second;
+}
+
+} // namespace core
+} // namespace bisky
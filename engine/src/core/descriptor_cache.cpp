@@ -0,0 +1,129 @@
+#include "core/descriptor_cache.h"
+#include "core/device.h"
+
+namespace bisky {
+namespace core {
+
+size_t DescriptorCache::KeyHash::operator()(const Vector<uint64_t> &key) const {
+  uint64_t hash = key.size();
+  for (uint64_t word : key) {
+    hash ^= word + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+  }
+  return static_cast<size_t>(hash);
+}
+
+void DescriptorCache::init(Pointer<Device> device, uint32_t frameCount, uint32_t initialSets,
+                           std::span<DescriptorAllocatorGrowable::PoolSizeRatio> poolRatios) {
+  _device = device;
+  _allocator.init(_device->device(), initialSets, poolRatios);
+
+  if (_device->hasDescriptorBuffer()) {
+    _buffers.resize(frameCount);
+    for (DescriptorBuffer &buffer : _buffers) {
+      buffer.init(_device, DESCRIPTOR_BUFFER_SIZE);
+    }
+  }
+}
+
+void DescriptorCache::cleanup() {
+  for (DescriptorBuffer &buffer : _buffers) {
+    buffer.cleanup();
+  }
+  _buffers.clear();
+
+  _allocator.destroyPools(_device->device());
+  _sets.clear();
+  _freeSets.clear();
+}
+
+void DescriptorCache::beginFrame(uint32_t frame) {
+  _frame = frame;
+  if (descriptorBuffers()) {
+    _buffers[frame].reset();
+  }
+}
+
+VkDescriptorSet DescriptorCache::get(VkDevice device, VkDescriptorSetLayout layout, DescriptorWriter &writer) {
+  _key.clear();
+  writer.appendKey(layout, _key);
+
+  auto it = _sets.find(_key);
+  if (it != _sets.end()) {
+    _hits++;
+    return it->second;
+  }
+  _misses++;
+
+  VkDescriptorSet set;
+  Vector<VkDescriptorSet> &freeSets = _freeSets[layout];
+  if (!freeSets.empty()) {
+    set = freeSets.back();
+    freeSets.pop_back();
+  } else {
+    set = _allocator.allocate(device, layout);
+  }
+
+  writer.updateSet(device, set);
+
+  _sets.emplace(_key, set);
+  return set;
+}
+
+bool DescriptorCache::references(const Vector<uint64_t> &key, uint64_t handle) {
+  // every write is five words after the layout, the handles are the third and fourth
+  for (size_t i = 1; i + WORDS_PER_WRITE <= key.size(); i += WORDS_PER_WRITE) {
+    if (key[i + 2] == handle || key[i + 3] == handle) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void DescriptorCache::bind(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout,
+                           uint32_t set, VkDescriptorSetLayout layout, DescriptorWriter &writer) {
+  if (descriptorBuffers()) {
+    DescriptorBuffer &buffer = _buffers[_frame];
+    GPURingBuffer::Allocation allocation = buffer.allocate(layout);
+    writer.updateBuffer(buffer, layout, allocation.data);
+    buffer.bind(cmd, bindPoint, pipelineLayout, set, allocation.offset);
+    return;
+  }
+
+  VkDescriptorSet descriptorSet = get(_device->device(), layout, writer);
+  vkCmdBindDescriptorSets(cmd, bindPoint, pipelineLayout, set, 1, &descriptorSet, 0, nullptr);
+}
+
+void DescriptorCache::evict(uint64_t handle, DeletionQueue *retired) {
+  if (!handle) {
+    return;
+  }
+
+  Vector<std::pair<VkDescriptorSetLayout, VkDescriptorSet>> evicted;
+  for (auto it = _sets.begin(); it != _sets.end();) {
+    if (references(it->first, handle)) {
+      evicted.emplace_back((VkDescriptorSetLayout)it->first[0], it->second);
+      it = _sets.erase(it);
+    } else {
+      it++;
+    }
+  }
+
+  if (evicted.empty()) {
+    return;
+  }
+
+  auto recycle = [this, evicted = std::move(evicted)]() {
+    for (auto [layout, set] : evicted) {
+      _freeSets[layout].push_back(set);
+    }
+  };
+
+  if (retired) {
+    retired->push_back(std::move(recycle));
+  } else {
+    recycle();
+  }
+}
+
+} // namespace core
+} // namespace bisky
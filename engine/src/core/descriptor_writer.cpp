@@ -1,11 +1,37 @@
 #include "core/descriptor_writer.h"
+#include "core/descriptor_buffer.h"
+#include "core/device.h"
 #include <vulkan/vulkan_core.h>
 
 namespace bisky {
 namespace core {
 
+namespace {
+
+size_t descriptorSize(const VkPhysicalDeviceDescriptorBufferPropertiesEXT &properties, VkDescriptorType type) {
+  switch (type) {
+  case VK_DESCRIPTOR_TYPE_SAMPLER:
+    return properties.samplerDescriptorSize;
+  case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+    return properties.combinedImageSamplerDescriptorSize;
+  case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+    return properties.sampledImageDescriptorSize;
+  case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+    return properties.storageImageDescriptorSize;
+  case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+    return properties.uniformBufferDescriptorSize;
+  case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+    return properties.storageBufferDescriptorSize;
+  default:
+    throw std::runtime_error(fmt::format("descriptor type {} is not supported in descriptor buffers",
+                                         string_VkDescriptorType(type)));
+  }
+}
+
+} // namespace
+
 void DescriptorWriter::writeImage(int binding, VkImageView image, VkSampler sampler, VkImageLayout layout,
-                                  VkDescriptorType type) {
+                                  VkDescriptorType type, uint32_t arrayElement) {
   VkDescriptorImageInfo &info = imageInfos.emplace_back(VkDescriptorImageInfo{
 
       .sampler = sampler,
@@ -16,6 +42,7 @@ void DescriptorWriter::writeImage(int binding, VkImageView image, VkSampler samp
   VkWriteDescriptorSet write = {};
   write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
   write.dstBinding = binding;
+  write.dstArrayElement = arrayElement;
   write.dstSet = VK_NULL_HANDLE;
   write.descriptorCount = 1;
   write.descriptorType = type;
@@ -38,6 +65,10 @@ void DescriptorWriter::writeBuffer(int binding, VkBuffer buffer, size_t size, si
   writes.push_back(write);
 }
 
+void DescriptorWriter::writeBuffer(int binding, const GPUBuffer &buffer, VkDescriptorType type) {
+  writeBuffer(binding, buffer.buffer, buffer.size, 0, type);
+}
+
 void DescriptorWriter::clear() {
   imageInfos.clear();
   writes.clear();
@@ -52,5 +83,75 @@ void DescriptorWriter::updateSet(VkDevice device, VkDescriptorSet set) {
   vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 }
 
+void DescriptorWriter::updateBuffer(DescriptorBuffer &buffer, VkDescriptorSetLayout layout, void *set) {
+  Device &device = buffer.device();
+  const VkPhysicalDeviceDescriptorBufferPropertiesEXT &properties = device.descriptorBufferProperties();
+
+  for (const VkWriteDescriptorSet &write : writes) {
+    VkDescriptorGetInfoEXT getInfo = {};
+    getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+    getInfo.type = write.descriptorType;
+
+    VkDescriptorAddressInfoEXT addressInfo = {};
+    addressInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+    if (write.pBufferInfo) {
+      if (write.pBufferInfo->range == VK_WHOLE_SIZE) {
+        throw std::runtime_error("descriptor buffers need an explicit buffer range");
+      }
+
+      VkBufferDeviceAddressInfo deviceAddressInfo = {};
+      deviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+      deviceAddressInfo.buffer = write.pBufferInfo->buffer;
+      addressInfo.address = vkGetBufferDeviceAddress(device.device(), &deviceAddressInfo) + write.pBufferInfo->offset;
+      addressInfo.range = write.pBufferInfo->range;
+    }
+
+    switch (write.descriptorType) {
+    case VK_DESCRIPTOR_TYPE_SAMPLER:
+      getInfo.data.pSampler = &write.pImageInfo->sampler;
+      break;
+    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+      getInfo.data.pCombinedImageSampler = write.pImageInfo;
+      break;
+    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+      getInfo.data.pSampledImage = write.pImageInfo;
+      break;
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+      getInfo.data.pStorageImage = write.pImageInfo;
+      break;
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+      getInfo.data.pUniformBuffer = &addressInfo;
+      break;
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+      getInfo.data.pStorageBuffer = &addressInfo;
+      break;
+    default:
+      break;
+    }
+
+    const size_t size = descriptorSize(properties, write.descriptorType);
+    char *destination = static_cast<char *>(set) + buffer.bindingOffset(layout, write.dstBinding) +
+                        write.dstArrayElement * size;
+    device.descriptorBufferFunctions().getDescriptor(device.device(), &getInfo, size, destination);
+  }
+}
+
+void DescriptorWriter::appendKey(VkDescriptorSetLayout layout, Vector<uint64_t> &key) const {
+  key.push_back((uint64_t)layout);
+  for (const VkWriteDescriptorSet &write : writes) {
+    key.push_back((uint64_t(write.dstBinding) << 32) | write.dstArrayElement);
+    key.push_back(write.descriptorType);
+    if (write.pImageInfo) {
+      key.push_back((uint64_t)write.pImageInfo->sampler);
+      key.push_back((uint64_t)write.pImageInfo->imageView);
+      key.push_back(write.pImageInfo->imageLayout);
+    } else {
+      key.push_back((uint64_t)write.pBufferInfo->buffer);
+      key.push_back(write.pBufferInfo->offset);
+      key.push_back(write.pBufferInfo->range);
+    }
+  }
+}
+
 } // namespace core
 } // namespace bisky
@@ -4,11 +4,11 @@
 namespace bisky {
 namespace core {
 
-DescriptorLayoutBuilder &DescriptorLayoutBuilder::add(uint32_t binding, VkDescriptorType type) {
+DescriptorLayoutBuilder &DescriptorLayoutBuilder::add(uint32_t binding, VkDescriptorType type, uint32_t count) {
   VkDescriptorSetLayoutBinding newbind = {};
   newbind.descriptorType = type;
   newbind.binding = binding;
-  newbind.descriptorCount = 1;
+  newbind.descriptorCount = count;
 
   bindings.push_back(newbind);
 
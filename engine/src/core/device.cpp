@@ -2,6 +2,7 @@
 
 #include "core/device.h"
 #include "utils/utils.h"
+#include <algorithm>
 #include <vulkan/vulkan_core.h>
 
 namespace bisky {
@@ -232,7 +233,7 @@ void Device::createInstance() {
   VkInstanceCreateInfo createInfo = {VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
   createInfo.pApplicationInfo = &appInfo;
 
-  auto extensions = utils::getRequiredExtensions();
+  auto extensions = utils::getRequiredExtensions(headless());
   createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
   createInfo.ppEnabledExtensionNames = extensions.data();
 
@@ -272,6 +273,10 @@ void Device::setupDebugMessenger() {
 }
 
 void Device::createWindowSurface() {
+  if (headless()) {
+    return;
+  }
+
   VK_CHECK(glfwCreateWindowSurface(_instance, _window->window(), nullptr, &_surface));
   _deletionQueue.push_back([&]() { vkDestroySurfaceKHR(_instance, _surface, nullptr); });
 }
@@ -293,20 +298,43 @@ void Device::pickPhysicalDevice() {
   if (_physicalDevice == VK_NULL_HANDLE) {
     throw std::runtime_error("failed to find a suitable GPU");
   }
+
+  vkGetPhysicalDeviceProperties(_physicalDevice, &_properties);
 }
 
 void Device::createLogicalDevice() {
   _indices = findQueueFamilies(_physicalDevice);
 
-  float queuePriorities = 1.0f;
+  float queuePriorities[] = {1.0f, 1.0f};
+  Vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+
   VkDeviceQueueCreateInfo queueCreateInfo = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
-  queueCreateInfo.queueCount = 1;
+  queueCreateInfo.queueCount = _indices.computeFamily == _indices.queueFamily ? 2 : 1;
   queueCreateInfo.queueFamilyIndex = _indices.queueFamily.value();
-  queueCreateInfo.pQueuePriorities = &queuePriorities;
+  queueCreateInfo.pQueuePriorities = queuePriorities;
+  queueCreateInfos.push_back(queueCreateInfo);
+
+  if (_indices.computeFamily && _indices.computeFamily != _indices.queueFamily) {
+    VkDeviceQueueCreateInfo computeQueueCreateInfo = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+    computeQueueCreateInfo.queueCount = 1;
+    computeQueueCreateInfo.queueFamilyIndex = _indices.computeFamily.value();
+    computeQueueCreateInfo.pQueuePriorities = queuePriorities;
+    queueCreateInfos.push_back(computeQueueCreateInfo);
+  }
+
+  if (_indices.transferFamily) {
+    VkDeviceQueueCreateInfo transferQueueCreateInfo = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+    transferQueueCreateInfo.queueCount = 1;
+    transferQueueCreateInfo.queueFamilyIndex = _indices.transferFamily.value();
+    transferQueueCreateInfo.pQueuePriorities = queuePriorities;
+    queueCreateInfos.push_back(transferQueueCreateInfo);
+  }
 
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
   deviceFeatures.shaderInt64 = VK_TRUE;
+  deviceFeatures.multiDrawIndirect = VK_TRUE;
+  deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
 
   VkPhysicalDeviceSynchronization2Features deviceSynchronizationFeatures = {};
   deviceSynchronizationFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
@@ -317,36 +345,94 @@ void Device::createLogicalDevice() {
   dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
   dynamicRenderingFeatures.pNext = &deviceSynchronizationFeatures;
 
-  VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddress = {};
-  bufferDeviceAddress.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
-  bufferDeviceAddress.bufferDeviceAddress = VK_TRUE;
-  bufferDeviceAddress.pNext = &dynamicRenderingFeatures;
-
-  std::vector<const char *> extensions(utils::deviceExtensions);
+  VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+  vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  vulkan12Features.bufferDeviceAddress = VK_TRUE;
+  vulkan12Features.drawIndirectCount = VK_TRUE;
+  vulkan12Features.hostQueryReset = VK_TRUE;
+  vulkan12Features.timelineSemaphore = VK_TRUE;
+  vulkan12Features.descriptorIndexing = VK_TRUE;
+  vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+  vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+  vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  vulkan12Features.pNext = &dynamicRenderingFeatures;
+
+  Vector<const char *> extensions = requiredExtensions();
+
+  // optional, descriptors fall back to pools without it
+  VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures = {};
+  descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+  if (supportsExtension(_physicalDevice, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 supportedFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    supportedFeatures.pNext = &descriptorBufferFeatures;
+    vkGetPhysicalDeviceFeatures2(_physicalDevice, &supportedFeatures);
+    _descriptorBuffer = descriptorBufferFeatures.descriptorBuffer;
+  }
 
-#if __APPLE__
-  extensions.push_back("VK_KHR_portability_subset");
-#endif
+  if (_descriptorBuffer) {
+    descriptorBufferFeatures = {};
+    descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+    descriptorBufferFeatures.descriptorBuffer = VK_TRUE;
+    deviceSynchronizationFeatures.pNext = &descriptorBufferFeatures;
+    extensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+  }
 
   for (auto &extensionName : extensions) {
     fmt::print("[extension] {}\n", extensionName);
   }
 
   VkDeviceCreateInfo createInfo = {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
-  createInfo.queueCreateInfoCount = 1;
-  createInfo.pQueueCreateInfos = &queueCreateInfo;
+  createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+  createInfo.pQueueCreateInfos = queueCreateInfos.data();
   createInfo.pEnabledFeatures = &deviceFeatures;
   createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
   createInfo.ppEnabledExtensionNames = extensions.data();
-  createInfo.pNext = &bufferDeviceAddress;
+  createInfo.pNext = &vulkan12Features;
 
   VK_CHECK(vkCreateDevice(_physicalDevice, &createInfo, nullptr, &_device));
 
   vkGetDeviceQueue(_device, _indices.queueFamily.value(), 0, &_queue);
 
+  _computeQueue = _queue;
+  if (_indices.computeFamily) {
+    vkGetDeviceQueue(_device, _indices.computeFamily.value(), _indices.computeQueueIndex, &_computeQueue);
+  }
+
+  _transferQueue = _queue;
+  if (_indices.transferFamily) {
+    vkGetDeviceQueue(_device, _indices.transferFamily.value(), 0, &_transferQueue);
+  }
+
+  if (_descriptorBuffer) {
+    loadDescriptorBuffer();
+  }
+
   _deletionQueue.push_back([&]() { vkDestroyDevice(_device, nullptr); });
 }
 
+void Device::loadDescriptorBuffer() {
+  _descriptorBufferProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+  VkPhysicalDeviceProperties2 properties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  properties.pNext = &_descriptorBufferProperties;
+  vkGetPhysicalDeviceProperties2(_physicalDevice, &properties);
+
+  DescriptorBufferFunctions &functions = _descriptorBufferFunctions;
+  functions.getLayoutSize =
+      (PFN_vkGetDescriptorSetLayoutSizeEXT)vkGetDeviceProcAddr(_device, "vkGetDescriptorSetLayoutSizeEXT");
+  functions.getBindingOffset = (PFN_vkGetDescriptorSetLayoutBindingOffsetEXT)vkGetDeviceProcAddr(
+      _device, "vkGetDescriptorSetLayoutBindingOffsetEXT");
+  functions.getDescriptor = (PFN_vkGetDescriptorEXT)vkGetDeviceProcAddr(_device, "vkGetDescriptorEXT");
+  functions.bindBuffers =
+      (PFN_vkCmdBindDescriptorBuffersEXT)vkGetDeviceProcAddr(_device, "vkCmdBindDescriptorBuffersEXT");
+  functions.setOffsets =
+      (PFN_vkCmdSetDescriptorBufferOffsetsEXT)vkGetDeviceProcAddr(_device, "vkCmdSetDescriptorBufferOffsetsEXT");
+
+  _descriptorBuffer = functions.getLayoutSize && functions.getBindingOffset && functions.getDescriptor &&
+                      functions.bindBuffers && functions.setOffsets;
+}
+
 QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -358,20 +444,36 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
 
   int i = 0;
   for (const auto &queueFamily : queueFamilies) {
-    VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+    VkBool32 presentSupport = headless();
+    if (!headless()) {
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &presentSupport);
+    }
 
-    if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && presentSupport) {
+    if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && presentSupport && !indices.queueFamily) {
       indices.queueFamily = i;
     }
 
-    if (indices.isComplete()) {
-      break;
+    // compute only families map to the asynchronous compute engines
+    if ((queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+        !indices.computeFamily) {
+      indices.computeFamily = i;
+    }
+
+    // transfer only families map to the copy engines, which run next to graphics and compute
+    if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+        !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && !indices.transferFamily) {
+      indices.transferFamily = i;
     }
 
     i++;
   }
 
+  // otherwise a second queue of the graphics family still lets the driver overlap the submissions
+  if (!indices.computeFamily && indices.queueFamily && queueFamilies[indices.queueFamily.value()].queueCount > 1) {
+    indices.computeFamily = indices.queueFamily;
+    indices.computeQueueIndex = 1;
+  }
+
   return indices;
 }
 
@@ -380,8 +482,8 @@ bool Device::isDeviceSuitable(VkPhysicalDevice device) {
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-  bool swapchainAdequate = false;
-  if (extensionsSupported) {
+  bool swapchainAdequate = headless();
+  if (extensionsSupported && !headless()) {
     SwapchainSupportDetails swapChainSupport = querySwapchainSupport(device);
     swapchainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
@@ -396,7 +498,8 @@ bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   std::vector<VkExtensionProperties> availableExtensions(extensionCount);
   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-  std::set<std::string> requiredExtensions(utils::deviceExtensions.begin(), utils::deviceExtensions.end());
+  Vector<const char *> extensions = requiredExtensions();
+  std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
   for (const auto &extension : availableExtensions) {
     requiredExtensions.erase(extension.extensionName);
@@ -405,6 +508,36 @@ bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+bool Device::supportsExtension(VkPhysicalDevice device, const char *name) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+  return std::any_of(availableExtensions.begin(), availableExtensions.end(),
+                     [name](const VkExtensionProperties &extension) {
+                       return std::strcmp(extension.extensionName, name) == 0;
+                     });
+}
+
+Vector<const char *> Device::requiredExtensions() {
+  Vector<const char *> extensions;
+  for (const char *extension : utils::deviceExtensions) {
+    // software drivers like lavapipe on display-less machines may not expose it
+    if (headless() && std::strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) {
+      continue;
+    }
+    extensions.push_back(extension);
+  }
+
+#if __APPLE__
+  extensions.push_back("VK_KHR_portability_subset");
+#endif
+
+  return extensions;
+}
+
 SwapchainSupportDetails Device::querySwapchainSupport(VkPhysicalDevice device) {
   SwapchainSupportDetails details;
 
@@ -0,0 +1,78 @@
+#include "core/image_state_tracker.h"
+#include "utils/init.h"
+
+namespace bisky {
+namespace core {
+
+VkImageMemoryBarrier2 ImageStateTracker::makeBarrier(VkImage image, VkImageAspectFlags aspect, const ImageState &src,
+                                                     const ImageState &dst) {
+  VkImageMemoryBarrier2 barrier = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+  barrier.srcStageMask = src.stages;
+  // only writes have to be made available, earlier reads just need to finish
+  barrier.srcAccessMask = src.access & WRITE_ACCESS;
+  barrier.dstStageMask = dst.stages;
+  barrier.dstAccessMask = dst.access;
+  barrier.oldLayout = src.layout;
+  barrier.newLayout = dst.layout;
+  barrier.image = image;
+  barrier.subresourceRange = init::imageSubresourceRange(aspect);
+
+  return barrier;
+}
+
+void ImageStateTracker::track(VkImage image, VkImageAspectFlags aspect, ImageState state) {
+  _images[image] = TrackedImage{aspect, state};
+}
+
+void ImageStateTracker::untrack(VkImage image) { _images.erase(image); }
+
+void ImageStateTracker::use(VkImage image, const ImageState &next) {
+  TrackedImage &tracked = _images.at(image);
+  ImageState &current = tracked.state;
+
+  if (tracked.pendingBarrier >= 0) {
+    // nothing was recorded since the queued barrier, so widen it instead of adding a second one for the image
+    VkImageMemoryBarrier2 &barrier = _barriers[tracked.pendingBarrier];
+    barrier.dstStageMask |= next.stages;
+    barrier.dstAccessMask |= next.access;
+    barrier.newLayout = next.layout;
+    current = {next.layout, barrier.dstStageMask, barrier.dstAccessMask};
+    return;
+  }
+
+  if (!needsBarrier(current, next)) {
+    current.stages |= next.stages;
+    current.access |= next.access;
+    return;
+  }
+
+  tracked.pendingBarrier = static_cast<int32_t>(_barriers.size());
+  _barriers.push_back(makeBarrier(image, tracked.aspect, current, next));
+  _pendingImages.push_back(image);
+  current = next;
+}
+
+void ImageStateTracker::flush(VkCommandBuffer cmd) {
+  if (_barriers.empty()) {
+    return;
+  }
+
+  VkDependencyInfo depInfo = {};
+  depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  depInfo.imageMemoryBarrierCount = static_cast<uint32_t>(_barriers.size());
+  depInfo.pImageMemoryBarriers = _barriers.data();
+  vkCmdPipelineBarrier2(cmd, &depInfo);
+
+  for (VkImage image : _pendingImages) {
+    auto it = _images.find(image);
+    if (it != _images.end()) {
+      it->second.pendingBarrier = -1;
+    }
+  }
+
+  _barriers.clear();
+  _pendingImages.clear();
+}
+
+} // namespace core
+} // namespace bisky
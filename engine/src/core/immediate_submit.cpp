@@ -1,5 +1,6 @@
 #include "core/device.h"
 
+#include "core/cpu_profiler.h"
 #include "core/immedate_submit.h"
 #include "utils/init.h"
 
@@ -10,7 +11,18 @@ ImmediateSubmit::ImmediateSubmit(Pointer<Device> device) : _device(device) { ini
 
 ImmediateSubmit::~ImmediateSubmit() {}
 
-void ImmediateSubmit::cleanup() { _deletionQueue.flush(); }
+void ImmediateSubmit::cleanup() {
+  if (_transferValue) {
+    VkSemaphoreWaitInfo waitInfo = {.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &_transferSemaphore;
+    waitInfo.pValues = &_transferValue;
+    VK_CHECK(vkWaitSemaphores(_device->device(), &waitInfo, UINT64_MAX));
+    collect();
+  }
+
+  _deletionQueue.flush();
+}
 
 void ImmediateSubmit::initialize() {
   // create command pool
@@ -27,25 +39,195 @@ void ImmediateSubmit::initialize() {
   VkFenceCreateInfo fenceInfo = init::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
   VK_CHECK(vkCreateFence(_device->device(), &fenceInfo, nullptr, &_fence));
   _deletionQueue.push_back([&]() { vkDestroyFence(_device->device(), _fence, nullptr); });
+
+  if (!_device->hasTransferQueue()) {
+    return;
+  }
+
+  VkCommandPoolCreateInfo transferPoolInfo =
+      init::commandPoolCreateInfo(_device->transferQueueFamily(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  VK_CHECK(vkCreateCommandPool(_device->device(), &transferPoolInfo, nullptr, &_transferCommandPool));
+  _deletionQueue.push_back([&]() { vkDestroyCommandPool(_device->device(), _transferCommandPool, nullptr); });
+
+  VkSemaphoreTypeCreateInfo timelineInfo = {.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+  timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  timelineInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo = init::semaphoreCreateInfo();
+  semaphoreInfo.pNext = &timelineInfo;
+  VK_CHECK(vkCreateSemaphore(_device->device(), &semaphoreInfo, nullptr, &_transferSemaphore));
+  _deletionQueue.push_back([&]() { vkDestroySemaphore(_device->device(), _transferSemaphore, nullptr); });
+}
+
+VkCommandBuffer ImmediateSubmit::takeCommandBuffer(Vector<VkCommandBuffer> &freeCommandBuffers, VkCommandPool pool) {
+  if (freeCommandBuffers.empty()) {
+    VkCommandBuffer commandBuffer;
+    VkCommandBufferAllocateInfo allocInfo = init::commandBufferAllocateInfo(pool);
+    VK_CHECK(vkAllocateCommandBuffers(_device->device(), &allocInfo, &commandBuffer));
+    return commandBuffer;
+  }
+
+  VkCommandBuffer commandBuffer = freeCommandBuffers.back();
+  freeCommandBuffers.pop_back();
+  VK_CHECK(vkResetCommandBuffer(commandBuffer, 0));
+  return commandBuffer;
 }
 
-void ImmediateSubmit::submit(std::function<void(VkCommandBuffer cmd)> &&function) {
-  VK_CHECK(vkResetFences(_device->device(), 1, &_fence));
-  VK_CHECK(vkResetCommandBuffer(_commandBuffer, 0));
+void ImmediateSubmit::upload(std::function<void(VkCommandBuffer cmd)> &&function,
+                             std::span<const BufferUpload> buffers, std::span<const ImageUpload> images,
+                             std::function<void()> &&release) {
+  BISKY_PROFILE_ZONE("ImmediateSubmit::upload");
+
+  const ImageState copied = {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_COPY_BIT,
+                             VK_ACCESS_2_TRANSFER_WRITE_BIT};
+  const bool ownershipTransfer = _device->hasTransferQueue();
+
+  Vector<VkImageMemoryBarrier2> imageBarriers;
+  for (const ImageUpload &upload : images) {
+    imageBarriers.push_back(ImageStateTracker::makeBarrier(upload.image, upload.aspect, {}, copied));
+  }
+
+  VkDependencyInfo depInfo = {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+  depInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+  depInfo.pImageMemoryBarriers = imageBarriers.data();
 
   VkCommandBuffer cmd = _commandBuffer;
+  if (ownershipTransfer) {
+    cmd = takeCommandBuffer(_freeTransferCommandBuffers, _transferCommandPool);
+  } else {
+    VK_CHECK(vkResetFences(_device->device(), 1, &_fence));
+    VK_CHECK(vkResetCommandBuffer(cmd, 0));
+  }
 
   VkCommandBufferBeginInfo cmdBeginInfo = init::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
   VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+  if (!imageBarriers.empty()) {
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+  }
 
   function(cmd);
 
+  // without a transfer queue these make the copies visible to their users, otherwise they are the release half of
+  // the ownership transfer and the graphics queue records the matching acquire
+  Vector<VkBufferMemoryBarrier2> bufferBarriers;
+  for (const BufferUpload &upload : buffers) {
+    VkBufferMemoryBarrier2 barrier = {.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2};
+    barrier.srcStageMask = copied.stages;
+    barrier.srcAccessMask = copied.access;
+    barrier.dstStageMask = upload.stages;
+    barrier.dstAccessMask = upload.access;
+    barrier.srcQueueFamilyIndex = ownershipTransfer ? _device->transferQueueFamily() : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = ownershipTransfer ? _device->queueFamily() : VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = upload.buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    bufferBarriers.push_back(barrier);
+  }
+
+  imageBarriers.clear();
+  for (const ImageUpload &upload : images) {
+    VkImageMemoryBarrier2 barrier = ImageStateTracker::makeBarrier(upload.image, upload.aspect, copied, upload.state);
+    barrier.srcQueueFamilyIndex = ownershipTransfer ? _device->transferQueueFamily() : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = ownershipTransfer ? _device->queueFamily() : VK_QUEUE_FAMILY_IGNORED;
+    imageBarriers.push_back(barrier);
+  }
+
+  if (ownershipTransfer) {
+    // the release ignores the destination scope and the acquire the source scope, both need the same layouts
+    for (VkBufferMemoryBarrier2 barrier : bufferBarriers) {
+      barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+      barrier.srcAccessMask = VK_ACCESS_2_NONE;
+      _acquireBufferBarriers.push_back(barrier);
+    }
+    for (VkImageMemoryBarrier2 barrier : imageBarriers) {
+      barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+      barrier.srcAccessMask = VK_ACCESS_2_NONE;
+      _acquireImageBarriers.push_back(barrier);
+    }
+
+    for (VkBufferMemoryBarrier2 &barrier : bufferBarriers) {
+      barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+      barrier.dstAccessMask = VK_ACCESS_2_NONE;
+    }
+    for (VkImageMemoryBarrier2 &barrier : imageBarriers) {
+      barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+      barrier.dstAccessMask = VK_ACCESS_2_NONE;
+    }
+  }
+
+  depInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+  depInfo.pBufferMemoryBarriers = bufferBarriers.data();
+  depInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+  depInfo.pImageMemoryBarriers = imageBarriers.data();
+  vkCmdPipelineBarrier2(cmd, &depInfo);
+
   VK_CHECK(vkEndCommandBuffer(cmd));
 
   VkCommandBufferSubmitInfo cmdInfo = init::commandBufferSubmitInfo(cmd);
-  VkSubmitInfo2 submitInfo = init::submitInfo(&cmdInfo, nullptr, nullptr);
-  VK_CHECK(vkQueueSubmit2(_device->queue(), 1, &submitInfo, _fence));
-  VK_CHECK(vkWaitForFences(_device->device(), 1, &_fence, true, UINT64_MAX));
+  if (!ownershipTransfer) {
+    VkSubmitInfo2 submitInfo = init::submitInfo(&cmdInfo, nullptr, nullptr);
+    VK_CHECK(vkQueueSubmit2(_device->queue(), 1, &submitInfo, _fence));
+    VK_CHECK(vkWaitForFences(_device->device(), 1, &_fence, true, UINT64_MAX));
+    if (release) {
+      release();
+    }
+    return;
+  }
+
+  // the copies never occupy the graphics queue and nothing waits for them here, the next frame acquires them
+  VkSemaphoreSubmitInfo signalInfo =
+      init::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _transferSemaphore);
+  signalInfo.value = ++_transferValue;
+  VkSubmitInfo2 transferSubmitInfo = init::submitInfo(&cmdInfo, &signalInfo, nullptr);
+  VK_CHECK(vkQueueSubmit2(_device->transferQueue(), 1, &transferSubmitInfo, VK_NULL_HANDLE));
+
+  _pending.push_back({_transferValue, cmd, std::move(release)});
+}
+
+void ImmediateSubmit::collect() {
+  if (_pending.empty()) {
+    return;
+  }
+
+  uint64_t completed;
+  VK_CHECK(vkGetSemaphoreCounterValue(_device->device(), _transferSemaphore, &completed));
+  while (!_pending.empty() && _pending.front().value <= completed) {
+    PendingUpload &upload = _pending.front();
+    if (upload.release) {
+      upload.release();
+    }
+    _freeTransferCommandBuffers.push_back(upload.commandBuffer);
+    _pending.pop_front();
+  }
+}
+
+bool ImmediateSubmit::acquire(DeletionQueue &retired, VkCommandBufferSubmitInfo &cmdInfo,
+                              VkSemaphoreSubmitInfo &wait) {
+  if (_acquireBufferBarriers.empty() && _acquireImageBarriers.empty()) {
+    return false;
+  }
+
+  VkCommandBuffer cmd = takeCommandBuffer(_freeAcquireCommandBuffers, _commandPool);
+  VkCommandBufferBeginInfo cmdBeginInfo = init::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+
+  VkDependencyInfo depInfo = {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+  depInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(_acquireBufferBarriers.size());
+  depInfo.pBufferMemoryBarriers = _acquireBufferBarriers.data();
+  depInfo.imageMemoryBarrierCount = static_cast<uint32_t>(_acquireImageBarriers.size());
+  depInfo.pImageMemoryBarriers = _acquireImageBarriers.data();
+  vkCmdPipelineBarrier2(cmd, &depInfo);
+
+  VK_CHECK(vkEndCommandBuffer(cmd));
+
+  _acquireBufferBarriers.clear();
+  _acquireImageBarriers.clear();
+  retired.push_back([this, cmd]() { _freeAcquireCommandBuffers.push_back(cmd); });
+
+  cmdInfo = init::commandBufferSubmitInfo(cmd);
+  wait = init::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _transferSemaphore);
+  wait.value = _transferValue;
+  return true;
 }
 
 } // namespace core
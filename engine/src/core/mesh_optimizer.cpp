@@ -0,0 +1,248 @@
+#include "core/mesh_optimizer.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace bisky {
+namespace core {
+
+namespace {
+
+constexpr uint32_t NONE = UINT32_MAX;
+
+// simulates a FIFO cache of CACHE_SIZE entries, a vertex is cached while fewer than CACHE_SIZE misses happened since
+// its own miss
+struct CacheSimulator {
+  Vector<uint32_t> times;
+  uint32_t time = MeshOptimizer::CACHE_SIZE + 1;
+
+  explicit CacheSimulator(size_t vertexCount) : times(vertexCount, 0) {}
+
+  bool cached(uint32_t vertex) const { return time - times[vertex] <= MeshOptimizer::CACHE_SIZE; }
+
+  // returns whether the vertex missed
+  bool use(uint32_t vertex) {
+    if (cached(vertex)) {
+      return false;
+    }
+    times[vertex] = time++;
+    return true;
+  }
+};
+
+} // namespace
+
+void MeshOptimizer::optimizeVertexCache(std::span<uint32_t> indices, size_t vertexCount) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // triangles around every vertex
+  Vector<uint32_t> offsets(vertexCount + 1, 0);
+  for (size_t i = 0; i < triangleCount * 3; i++) {
+    offsets[indices[i] + 1]++;
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  Vector<uint32_t> adjacency(triangleCount * 3);
+  Vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t i = 0; i < triangleCount * 3; i++) {
+    adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  // triangles not yet emitted around every vertex
+  Vector<uint32_t> live(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    live[v] = offsets[v + 1] - offsets[v];
+  }
+
+  Vector<uint32_t> result;
+  result.reserve(triangleCount * 3);
+  Vector<bool> emitted(triangleCount, false);
+  Vector<uint32_t> deadEnd;
+  Vector<uint32_t> candidates;
+  CacheSimulator cache(vertexCount);
+  uint32_t cursor = 0;
+
+  // the first fan starts at the first vertex of the first triangle
+  uint32_t fan = indices[0];
+  while (fan != NONE) {
+    candidates.clear();
+    for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; a++) {
+      const uint32_t triangle = adjacency[a];
+      if (emitted[triangle]) {
+        continue;
+      }
+      emitted[triangle] = true;
+
+      for (uint32_t k = 0; k < 3; k++) {
+        const uint32_t v = indices[triangle * 3 + k];
+        result.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        cache.use(v);
+      }
+    }
+
+    // prefer the candidate that stays in the cache for its remaining fan and entered it the earliest
+    fan = NONE;
+    int32_t bestPriority = -1;
+    for (uint32_t v : candidates) {
+      if (!live[v]) {
+        continue;
+      }
+
+      int32_t priority = 0;
+      const uint32_t age = cache.time - cache.times[v];
+      if (age + 2 * live[v] <= CACHE_SIZE) {
+        priority = static_cast<int32_t>(age);
+      }
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        fan = v;
+      }
+    }
+
+    // dead end, continue with a recently used vertex or the next one with triangles left
+    while (fan == NONE && !deadEnd.empty()) {
+      const uint32_t v = deadEnd.back();
+      deadEnd.pop_back();
+      if (live[v]) {
+        fan = v;
+      }
+    }
+    while (fan == NONE && cursor < vertexCount) {
+      if (live[cursor]) {
+        fan = cursor;
+      }
+      cursor++;
+    }
+  }
+
+  std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void MeshOptimizer::optimizeOverdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount < 2) {
+    return;
+  }
+
+  Vector<uint32_t> clusterStarts;
+  CacheSimulator cache(vertices.size());
+  for (size_t t = 0; t < triangleCount; t++) {
+    uint32_t misses = 0;
+    for (uint32_t k = 0; k < 3; k++) {
+      misses += cache.use(indices[t * 3 + k]);
+    }
+    if (misses == 3 || t == 0) {
+      clusterStarts.push_back(static_cast<uint32_t>(t));
+    }
+  }
+  clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+  struct Cluster {
+    uint32_t first;
+    uint32_t count;
+    glm::vec3 centroid;
+    glm::vec3 normal;
+    float area;
+    float sortKey;
+  };
+
+  Vector<Cluster> clusters;
+  glm::vec3 meshCentroid = glm::vec3(0.0f);
+  float meshArea = 0.0f;
+  for (size_t c = 0; c + 1 < clusterStarts.size(); c++) {
+    Cluster cluster = {};
+    cluster.first = clusterStarts[c];
+    cluster.count = clusterStarts[c + 1] - clusterStarts[c];
+    cluster.centroid = glm::vec3(0.0f);
+    cluster.normal = glm::vec3(0.0f);
+
+    for (uint32_t t = cluster.first; t < cluster.first + cluster.count; t++) {
+      const glm::vec3 &p0 = vertices[indices[t * 3 + 0]].position;
+      const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].position;
+      const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].position;
+
+      // the cross product's length is twice the area, both weights cancel out
+      const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+      const float area = glm::length(normal);
+      cluster.centroid += (p0 + p1 + p2) / 3.0f * area;
+      cluster.normal += normal;
+      cluster.area += area;
+    }
+
+    meshCentroid += cluster.centroid;
+    meshArea += cluster.area;
+    if (cluster.area > 0.0f) {
+      cluster.centroid /= cluster.area;
+    }
+    clusters.push_back(cluster);
+  }
+
+  if (meshArea <= 0.0f) {
+    return;
+  }
+  meshCentroid /= meshArea;
+
+  // clusters facing away from the center are the outer surface, which should be drawn first
+  for (Cluster &cluster : clusters) {
+    const float length = glm::length(cluster.normal);
+    cluster.sortKey = length > 0.0f ? glm::dot(cluster.centroid - meshCentroid, cluster.normal / length) : 0.0f;
+  }
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+  Vector<uint32_t> result;
+  result.reserve(triangleCount * 3);
+  for (const Cluster &cluster : clusters) {
+    result.insert(result.end(), indices.begin() + cluster.first * 3,
+                  indices.begin() + (cluster.first + cluster.count) * 3);
+  }
+  std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void MeshOptimizer::optimizeVertexFetch(Vector<Vertex> &vertices, std::span<uint32_t> indices) {
+  Vector<uint32_t> remap(vertices.size(), NONE);
+  uint32_t next = 0;
+  for (uint32_t index : indices) {
+    if (remap[index] == NONE) {
+      remap[index] = next++;
+    }
+  }
+  for (uint32_t &index : remap) {
+    if (index == NONE) {
+      index = next++;
+    }
+  }
+
+  Vector<Vertex> reordered(vertices.size());
+  for (size_t v = 0; v < vertices.size(); v++) {
+    reordered[remap[v]] = vertices[v];
+  }
+  vertices = std::move(reordered);
+
+  for (uint32_t &index : indices) {
+    index = remap[index];
+  }
+}
+
+float MeshOptimizer::averageCacheMissRatio(std::span<const uint32_t> indices, size_t vertexCount) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return 0.0f;
+  }
+
+  CacheSimulator cache(vertexCount);
+  uint32_t misses = 0;
+  for (size_t i = 0; i < triangleCount * 3; i++) {
+    misses += cache.use(indices[i]);
+  }
+  return static_cast<float>(misses) / triangleCount;
+}
+
+} // namespace core
+} // namespace bisky
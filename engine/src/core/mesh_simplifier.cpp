@@ -0,0 +1,282 @@
+#include "core/mesh_simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace bisky {
+namespace core {
+
+MeshSimplifier::Quadric MeshSimplifier::Quadric::fromPlane(const glm::dvec3 &n, double d, double weight) {
+  Quadric q = {};
+  q.a00 = n.x * n.x * weight;
+  q.a11 = n.y * n.y * weight;
+  q.a22 = n.z * n.z * weight;
+  q.a10 = n.y * n.x * weight;
+  q.a20 = n.z * n.x * weight;
+  q.a21 = n.z * n.y * weight;
+  q.b0 = n.x * d * weight;
+  q.b1 = n.y * d * weight;
+  q.b2 = n.z * d * weight;
+  q.c = d * d * weight;
+  q.weight = weight;
+  return q;
+}
+
+MeshSimplifier::Quadric &MeshSimplifier::Quadric::operator+=(const Quadric &other) {
+  a00 += other.a00;
+  a11 += other.a11;
+  a22 += other.a22;
+  a10 += other.a10;
+  a20 += other.a20;
+  a21 += other.a21;
+  b0 += other.b0;
+  b1 += other.b1;
+  b2 += other.b2;
+  c += other.c;
+  weight += other.weight;
+  return *this;
+}
+
+double MeshSimplifier::Quadric::error(const glm::vec3 &p) const {
+  if (weight <= 0.0) {
+    return 0.0;
+  }
+
+  const double x = p.x, y = p.y, z = p.z;
+  const double r = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a10 * x * y + a20 * x * z + a21 * y * z) +
+                   2.0 * (b0 * x + b1 * y + b2 * z) + c;
+  return std::max(r, 0.0) / weight;
+}
+
+Vector<uint32_t> MeshSimplifier::simplify(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                                          size_t targetIndexCount, float maxError, float *resultError) {
+  Vector<uint32_t> result(indices.begin(), indices.end());
+  if (resultError) {
+    *resultError = 0.0f;
+  }
+  if (result.size() <= targetIndexCount || vertices.empty()) {
+    return result;
+  }
+
+  const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+  Vector<uint8_t> locked;
+  lockBordersAndSeams(vertices, indices, locked);
+
+  glm::vec3 minPos = vertices[indices[0]].position;
+  glm::vec3 maxPos = minPos;
+  Vector<Quadric> quadrics(vertexCount, Quadric{});
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    const glm::dvec3 p0 = vertices[indices[i + 0]].position;
+    const glm::dvec3 p1 = vertices[indices[i + 1]].position;
+    const glm::dvec3 p2 = vertices[indices[i + 2]].position;
+
+    glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+    const double length = glm::length(normal);
+    if (length > 0.0) {
+      normal /= length;
+      // half the cross product is the area, so larger triangles pull harder
+      const Quadric quadric = Quadric::fromPlane(normal, -glm::dot(normal, p0), length * 0.5);
+      quadrics[indices[i + 0]] += quadric;
+      quadrics[indices[i + 1]] += quadric;
+      quadrics[indices[i + 2]] += quadric;
+    }
+
+    for (uint32_t k = 0; k < 3; k++) {
+      minPos = glm::min(minPos, vertices[indices[i + k]].position);
+      maxPos = glm::max(maxPos, vertices[indices[i + k]].position);
+    }
+  }
+
+  const double extent = glm::length(maxPos - minPos);
+  const double maxCost = (maxError * extent) * (maxError * extent);
+  double resultCost = 0.0;
+
+  Vector<uint32_t> offsets(vertexCount + 1);
+  Vector<uint32_t> triangles;
+  Vector<Collapse> collapses;
+  Vector<uint32_t> remap(vertexCount);
+  Vector<uint8_t> touched(vertexCount);
+
+  // every pass collapses a set of edges whose neighbourhoods do not overlap, then rebuilds the adjacency
+  while (result.size() > targetIndexCount) {
+    const uint32_t triangleCount = static_cast<uint32_t>(result.size() / 3);
+
+    std::fill(offsets.begin(), offsets.end(), 0);
+    for (uint32_t index : result) {
+      offsets[index + 1]++;
+    }
+    for (uint32_t v = 0; v < vertexCount; v++) {
+      offsets[v + 1] += offsets[v];
+    }
+    triangles.resize(result.size());
+    {
+      Vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+      for (uint32_t t = 0; t < triangleCount; t++) {
+        for (uint32_t k = 0; k < 3; k++) {
+          triangles[fill[result[t * 3 + k]]++] = t;
+        }
+      }
+    }
+
+    collapses.clear();
+    for (uint32_t t = 0; t < triangleCount; t++) {
+      for (uint32_t k = 0; k < 3; k++) {
+        const uint32_t a = result[t * 3 + k];
+        const uint32_t b = result[t * 3 + (k + 1) % 3];
+        if (!locked[a]) {
+          collapses.push_back({a, b, quadrics[a].error(vertices[b].position)});
+        }
+        if (!locked[b]) {
+          collapses.push_back({b, a, quadrics[b].error(vertices[a].position)});
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse &x, const Collapse &y) { return x.error < y.error; });
+
+    std::iota(remap.begin(), remap.end(), 0);
+    std::fill(touched.begin(), touched.end(), 0);
+
+    const uint32_t targetTriangles = static_cast<uint32_t>(targetIndexCount / 3);
+    uint32_t removed = 0;
+    uint32_t applied = 0;
+    for (const Collapse &collapse : collapses) {
+      if (collapse.error > maxCost || triangleCount - removed <= targetTriangles) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to]) {
+        continue;
+      }
+
+      std::span<const uint32_t> around(triangles.data() + offsets[collapse.from],
+                                       offsets[collapse.from + 1] - offsets[collapse.from]);
+      if (flipsTriangle(vertices, result, around, collapse)) {
+        continue;
+      }
+
+      // the collapsing vertex's neighbourhood changes shape, collapses next to it wait for the next pass
+      for (uint32_t t : around) {
+        const uint32_t *triangle = &result[t * 3];
+        touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+        removed += triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to;
+      }
+
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      resultCost = std::max(resultCost, collapse.error);
+      applied++;
+    }
+
+    if (!applied) {
+      break;
+    }
+
+    size_t write = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      const uint32_t a = remap[result[i + 0]];
+      const uint32_t b = remap[result[i + 1]];
+      const uint32_t c = remap[result[i + 2]];
+      if (a != b && b != c && a != c) {
+        result[write++] = a;
+        result[write++] = b;
+        result[write++] = c;
+      }
+    }
+    result.resize(write);
+  }
+
+  if (resultError) {
+    *resultError = static_cast<float>(std::sqrt(resultCost));
+  }
+  return result;
+}
+
+void MeshSimplifier::lockBordersAndSeams(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                                         Vector<uint8_t> &locked) {
+  const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+  // vertices sharing a position get one canonical id, several of them at one position make it a seam
+  Vector<uint32_t> order(vertexCount);
+  std::iota(order.begin(), order.end(), 0);
+  auto less = [&](uint32_t a, uint32_t b) {
+    const glm::vec3 &pa = vertices[a].position;
+    const glm::vec3 &pb = vertices[b].position;
+    return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+  };
+  std::sort(order.begin(), order.end(), less);
+
+  Vector<uint32_t> canonical(vertexCount);
+  Vector<uint8_t> lockedPosition(vertexCount, 0);
+  for (uint32_t i = 0; i < vertexCount;) {
+    uint32_t end = i + 1;
+    while (end < vertexCount && vertices[order[end]].position == vertices[order[i]].position) {
+      end++;
+    }
+    for (uint32_t j = i; j < end; j++) {
+      canonical[order[j]] = order[i];
+    }
+    lockedPosition[order[i]] = end - i > 1;
+    i = end;
+  }
+
+  // an edge used by one triangle is on a border, by more than two it is non-manifold
+  Vector<uint64_t> edges;
+  edges.reserve(indices.size());
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    for (uint32_t k = 0; k < 3; k++) {
+      const uint32_t a = canonical[indices[i + k]];
+      const uint32_t b = canonical[indices[i + (k + 1) % 3]];
+      edges.push_back((uint64_t(std::min(a, b)) << 32) | std::max(a, b));
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+
+  for (size_t i = 0; i < edges.size();) {
+    size_t end = i + 1;
+    while (end < edges.size() && edges[end] == edges[i]) {
+      end++;
+    }
+    if (end - i != 2) {
+      lockedPosition[edges[i] >> 32] = 1;
+      lockedPosition[edges[i] & 0xffffffff] = 1;
+    }
+    i = end;
+  }
+
+  locked.resize(vertexCount);
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    locked[v] = lockedPosition[canonical[v]];
+  }
+}
+
+bool MeshSimplifier::flipsTriangle(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                                   std::span<const uint32_t> triangles, const Collapse &collapse) {
+  const glm::vec3 &target = vertices[collapse.to].position;
+
+  for (uint32_t t : triangles) {
+    const uint32_t *triangle = &indices[t * 3];
+    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+      continue;
+    }
+
+    glm::vec3 before[3];
+    glm::vec3 after[3];
+    for (uint32_t k = 0; k < 3; k++) {
+      before[k] = vertices[triangle[k]].position;
+      after[k] = triangle[k] == collapse.from ? target : before[k];
+    }
+
+    const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+    const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+    if (glm::dot(normalBefore, normalAfter) <= 0.0f) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+} // namespace core
+} // namespace bisky
@@ -0,0 +1,124 @@
+#include "core/meshlet_builder.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bisky {
+namespace core {
+
+namespace {
+
+constexpr uint32_t UNUSED = UINT32_MAX;
+
+} // namespace
+
+uint32_t MeshletBuilder::build(std::span<const Vertex> vertices, std::span<const uint32_t> indices,
+                               MeshletData &data) {
+  const size_t firstMeshlet = data.meshlets.size();
+
+  // position of every mesh vertex within the current cluster
+  Vector<uint32_t> local(vertices.size(), UNUSED);
+
+  Meshlet meshlet = {};
+  meshlet.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+  meshlet.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+
+  auto finish = [&]() {
+    computeBounds(vertices, data, meshlet);
+    data.meshlets.push_back(meshlet);
+
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+      local[data.vertices[meshlet.vertexOffset + i]] = UNUSED;
+    }
+
+    meshlet = {};
+    meshlet.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+    meshlet.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+  };
+
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const uint32_t triangle[3] = {indices[i], indices[i + 1], indices[i + 2]};
+
+    uint32_t newVertices = 0;
+    for (uint32_t v : triangle) {
+      newVertices += local[v] == UNUSED;
+    }
+    if (meshlet.vertexCount + newVertices > MAX_VERTICES || meshlet.triangleCount == MAX_TRIANGLES) {
+      finish();
+      newVertices = 3;
+    }
+
+    for (uint32_t v : triangle) {
+      if (local[v] == UNUSED) {
+        local[v] = meshlet.vertexCount++;
+        data.vertices.push_back(v);
+      }
+    }
+
+    data.triangles.push_back(local[triangle[0]] | (local[triangle[1]] << 8) | (local[triangle[2]] << 16));
+    meshlet.triangleCount++;
+  }
+
+  if (meshlet.triangleCount > 0) {
+    finish();
+  }
+
+  return static_cast<uint32_t>(data.meshlets.size() - firstMeshlet);
+}
+
+void MeshletBuilder::computeBounds(std::span<const Vertex> vertices, const MeshletData &data, Meshlet &meshlet) {
+  const uint32_t *meshletVertices = &data.vertices[meshlet.vertexOffset];
+
+  glm::vec3 minPos = vertices[meshletVertices[0]].position;
+  glm::vec3 maxPos = minPos;
+  for (uint32_t i = 1; i < meshlet.vertexCount; i++) {
+    minPos = glm::min(minPos, vertices[meshletVertices[i]].position);
+    maxPos = glm::max(maxPos, vertices[meshletVertices[i]].position);
+  }
+
+  meshlet.center = (minPos + maxPos) * 0.5f;
+  meshlet.radius = 0.0f;
+  for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+    meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, vertices[meshletVertices[i]].position));
+  }
+
+  Vector<glm::vec3> normals;
+  normals.reserve(meshlet.triangleCount);
+  glm::vec3 axis = glm::vec3(0.0f);
+  for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+    const uint32_t packed = data.triangles[meshlet.triangleOffset + t];
+    const glm::vec3 &p0 = vertices[meshletVertices[packed & 0xff]].position;
+    const glm::vec3 &p1 = vertices[meshletVertices[(packed >> 8) & 0xff]].position;
+    const glm::vec3 &p2 = vertices[meshletVertices[(packed >> 16) & 0xff]].position;
+
+    const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    const float length = glm::length(normal);
+    if (length > 0.0f) {
+      normals.push_back(normal / length);
+      axis += normals.back();
+    }
+  }
+
+  // normals spreading over a hemisphere or more leave no direction the whole cluster faces away from
+  meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+  meshlet.coneCutoff = 1.0f;
+  if (glm::length(axis) <= 1e-6f) {
+    return;
+  }
+
+  axis = glm::normalize(axis);
+  float minDot = 1.0f;
+  for (const glm::vec3 &normal : normals) {
+    minDot = std::min(minDot, glm::dot(axis, normal));
+  }
+
+  meshlet.coneAxis = axis;
+  if (minDot > 0.0f) {
+    // sine of the cone's half angle, the cluster faces away once the angle between the view direction and the axis
+    // is below 90 degrees minus the half angle
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+  }
+}
+
+} // namespace core
+} // namespace bisky
@@ -0,0 +1,67 @@
+#include "core/thread_pool.h"
+#include "core/cpu_profiler.h"
+
+namespace bisky {
+namespace core {
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+  for (uint32_t i = 0; i < threadCount; i++) {
+    _threads.emplace_back([this]() { workerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+
+  for (std::thread &thread : _threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)> &task) {
+  if (count == 0) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _task = &task;
+  _count = count;
+  _next = 0;
+  _remaining = count;
+  _wake.notify_all();
+
+  _done.wait(lock, [this]() { return _remaining == 0; });
+  _task = nullptr;
+  _count = 0;
+  _next = 0;
+}
+
+void ThreadPool::workerLoop() {
+  BISKY_PROFILE_THREAD("worker");
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _wake.wait(lock, [this]() { return _stop || _next < _count; });
+    if (_stop) {
+      return;
+    }
+
+    uint32_t index = _next++;
+    const std::function<void(uint32_t)> &task = *_task;
+
+    lock.unlock();
+    task(index);
+    lock.lock();
+
+    if (--_remaining == 0) {
+      _done.notify_all();
+    }
+  }
+}
+
+} // namespace core
+} // namespace bisky
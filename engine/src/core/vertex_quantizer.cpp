@@ -0,0 +1,65 @@
+#include "core/vertex_quantizer.h"
+
+#include <glm/gtc/packing.hpp>
+
+namespace bisky {
+namespace core {
+
+VertexQuantization VertexQuantizer::quantize(std::span<const Vertex> vertices, Vector<CompactVertex> &compactVertices) {
+  compactVertices.resize(vertices.size());
+
+  VertexQuantization quantization = {glm::vec3(0.0f), glm::vec3(1.0f)};
+  if (vertices.empty()) {
+    return quantization;
+  }
+
+  glm::vec3 minPos = vertices[0].position;
+  glm::vec3 maxPos = minPos;
+  for (const Vertex &vertex : vertices) {
+    minPos = glm::min(minPos, vertex.position);
+    maxPos = glm::max(maxPos, vertex.position);
+  }
+
+  quantization.offset = minPos;
+  quantization.scale = maxPos - minPos;
+
+  for (int axis = 0; axis < 3; axis++) {
+    // every position on a flat axis quantizes to zero, any scale dequantizes it
+    if (quantization.scale[axis] <= 0.0f) {
+      quantization.scale[axis] = 1.0f;
+    }
+  }
+
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const Vertex &vertex = vertices[i];
+    const glm::vec3 position = glm::clamp((vertex.position - minPos) / quantization.scale, 0.0f, 1.0f);
+
+    CompactVertex &compact = compactVertices[i];
+    compact.positionXY = glm::packUnorm2x16(glm::vec2(position.x, position.y));
+    compact.positionZNormal =
+        glm::packUnorm1x16(position.z) | (uint32_t(glm::packSnorm2x8(encodeOctahedral(vertex.normal))) << 16);
+    compact.uv = glm::packHalf2x16(glm::vec2(vertex.uv_x, vertex.uv_y));
+    compact.color = glm::packUnorm4x8(vertex.color);
+  }
+
+  return quantization;
+}
+
+glm::vec2 VertexQuantizer::encodeOctahedral(glm::vec3 normal) {
+  const float length = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+  if (length <= 0.0f) {
+    return glm::vec2(0.0f);
+  }
+  normal /= length;
+
+  glm::vec2 encoded = glm::vec2(normal.x, normal.y);
+  if (normal.z < 0.0f) {
+    // fold the lower hemisphere over the diagonals
+    const glm::vec2 sign = glm::vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+    encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+  }
+  return encoded;
+}
+
+} // namespace core
+} // namespace bisky
@@ -16,6 +16,7 @@ GPUBuffer GPUBuffer::Builder::build(VmaAllocator allocator, size_t allocSize, Vk
   allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
 
   VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, &buffer.info));
+  buffer.size = allocSize;
   return buffer;
 }
 
@@ -4,6 +4,7 @@ namespace bisky {
 
 void GPUMeshBuffers::cleanup(VmaAllocator allocator) {
   vertexBuffer.cleanup(allocator);
+  compactVertexBuffer.cleanup(allocator);
   indexBuffer.cleanup(allocator);
 }
 
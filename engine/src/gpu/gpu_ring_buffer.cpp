@@ -0,0 +1,34 @@
+#include "gpu/gpu_ring_buffer.h"
+
+namespace bisky {
+
+void GPURingBuffer::init(VkDevice device, VmaAllocator allocator, size_t size, size_t alignment,
+                         VkBufferUsageFlags usage) {
+  GPUBuffer::Builder builder;
+  _buffer = builder.build(allocator, size, usage, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+  if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+    VkBufferDeviceAddressInfo deviceAddressInfo = {};
+    deviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    deviceAddressInfo.buffer = _buffer.buffer;
+    _deviceAddress = vkGetBufferDeviceAddress(device, &deviceAddressInfo);
+  }
+  _size = size;
+  _alignment = alignment;
+  _head = 0;
+}
+
+void GPURingBuffer::cleanup(VmaAllocator allocator) { _buffer.cleanup(allocator); }
+
+GPURingBuffer::Allocation GPURingBuffer::allocate(size_t size) {
+  size_t offset = (_head + _alignment - 1) & ~(_alignment - 1);
+  if (offset + size > _size) {
+    throw std::runtime_error("ring buffer out of memory");
+  }
+
+  _head = offset + size;
+  return Allocation{.data = static_cast<char *>(_buffer.info.pMappedData) + offset,
+                    .offset = static_cast<uint32_t>(offset)};
+}
+
+} // namespace bisky
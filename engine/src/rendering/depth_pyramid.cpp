@@ -0,0 +1,196 @@
+#include "rendering/depth_pyramid.h"
+#include "core/descriptors.h"
+#include "core/device.h"
+#include "utils/init.h"
+#include "utils/utils.h"
+
+#include <bit>
+
+namespace bisky {
+namespace rendering {
+
+namespace {
+
+// how the late cull reads the pyramid between builds
+constexpr core::ImageState READ_STATE = {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                         VK_ACCESS_2_SHADER_SAMPLED_READ_BIT};
+
+uint32_t levelsFor(VkExtent2D size) { return std::bit_width(std::max(size.width, size.height)); }
+
+VkExtent2D levelSize(VkExtent2D size, uint32_t level) {
+  return {std::max(size.width >> level, 1u), std::max(size.height >> level, 1u)};
+}
+
+} // namespace
+
+DepthPyramid::DepthPyramid(Pointer<core::Device> device, Pointer<core::DescriptorCache> descriptorCache)
+    : _device(device), _descriptorCache(descriptorCache) {}
+
+DepthPyramid::~DepthPyramid() {}
+
+void DepthPyramid::cleanup() {
+  releaseImage(nullptr);
+  _deletionQueue.flush();
+}
+
+void DepthPyramid::buildPipeline(Slang::ComPtr<slang::ISession> session) {
+  {
+    core::DescriptorLayoutBuilder builder;
+    _descriptorLayout = builder.add(0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE)
+                            .add(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+                            .build(_device->device(), VK_SHADER_STAGE_COMPUTE_BIT, nullptr,
+                                   _descriptorCache->layoutFlags());
+  }
+
+  VkPushConstantRange range = {};
+  range.offset = 0;
+  range.size = sizeof(GPUDepthPyramidPushConstants);
+  range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo layoutInfo = init::pipelineLayoutCreateInfo();
+  layoutInfo.setLayoutCount = 1;
+  layoutInfo.pSetLayouts = &_descriptorLayout;
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &range;
+  VK_CHECK(vkCreatePipelineLayout(_device->device(), &layoutInfo, nullptr, &_pipelineLayout));
+
+  slang::IModule *module = utils::createSlangModule(session, "../resources/shaders/compute/depth_pyramid.slang");
+  VkShaderModule shader;
+  if (!utils::loadShaderModule(session, module, _device->device(), "reduceMain", &shader)) {
+    throw std::runtime_error("failed to create depth pyramid shader module");
+  }
+
+  VkComputePipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.flags = _descriptorCache->pipelineFlags();
+  pipelineInfo.layout = _pipelineLayout;
+  pipelineInfo.stage = init::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shader);
+  VK_CHECK(vkCreateComputePipelines(_device->device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipeline));
+
+  vkDestroyShaderModule(_device->device(), shader, nullptr);
+
+  _deletionQueue.push_back([&]() {
+    vkDestroyPipeline(_device->device(), _pipeline, nullptr);
+    vkDestroyPipelineLayout(_device->device(), _pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device->device(), _descriptorLayout, nullptr);
+  });
+}
+
+void DepthPyramid::resize(VkExtent2D extent, core::DeletionQueue *retired) {
+  releaseImage(retired);
+
+  const VkExtent2D size = {std::bit_floor(std::max(extent.width, 1u)), std::bit_floor(std::max(extent.height, 1u))};
+  const uint32_t levels = levelsFor(size);
+
+  _image.format = FORMAT;
+  _image.extent = {size.width, size.height, 1};
+
+  VkImageCreateInfo imageInfo =
+      init::imageCreateInfo(FORMAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, _image.extent);
+  imageInfo.mipLevels = levels;
+
+  VmaAllocationCreateInfo allocInfo = {};
+  allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+  allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  VK_CHECK(vmaCreateImage(_device->allocator(), &imageInfo, &allocInfo, &_image.image, &_image.allocation, nullptr));
+
+  VkImageViewCreateInfo viewInfo = init::imageViewCreateInfo(FORMAT, _image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+  viewInfo.subresourceRange.levelCount = levels;
+  VK_CHECK(vkCreateImageView(_device->device(), &viewInfo, nullptr, &_image.imageView));
+
+  // every level is read and written through its own view while the pyramid is built
+  viewInfo.subresourceRange.levelCount = 1;
+  _levelViews.resize(levels);
+  for (uint32_t level = 0; level < levels; level++) {
+    viewInfo.subresourceRange.baseMipLevel = level;
+    VK_CHECK(vkCreateImageView(_device->device(), &viewInfo, nullptr, &_levelViews[level]));
+  }
+
+  _state = {};
+  _size = size;
+  _levelCount = levels;
+}
+
+void DepthPyramid::initializeLayout(VkCommandBuffer cmd) {
+  if (_state.layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+    barrier(cmd, READ_STATE);
+  }
+}
+
+void DepthPyramid::build(VkCommandBuffer cmd, VkImageView depth, VkExtent2D drawExtent) {
+  _size = {std::min(std::bit_floor(std::max(drawExtent.width, 1u)), _image.extent.width),
+           std::min(std::bit_floor(std::max(drawExtent.height, 1u)), _image.extent.height)};
+  _levelCount = levelsFor(_size);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+
+  VkExtent2D sourceSize = drawExtent;
+  for (uint32_t level = 0; level < _levelCount; level++) {
+    // the previous level is written by the last dispatch, reads of the last build have to finish before overwriting
+    barrier(cmd, {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                  VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT});
+
+    core::DescriptorWriter writer;
+    writer.writeImage(0, level ? _levelViews[level - 1] : depth, VK_NULL_HANDLE,
+                      level ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                      VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+    writer.writeImage(1, _levelViews[level], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    _descriptorCache->bind(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, _descriptorLayout, writer);
+
+    const VkExtent2D size = levelSize(_size, level);
+    GPUDepthPyramidPushConstants pushConstants = {};
+    pushConstants.sourceSize = {sourceSize.width, sourceSize.height};
+    pushConstants.size = {size.width, size.height};
+    pushConstants.fromDepth = level == 0;
+
+    vkCmdPushConstants(cmd, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkCmdDispatch(cmd, (size.width + 7) / 8, (size.height + 7) / 8, 1);
+
+    sourceSize = size;
+  }
+
+  barrier(cmd, READ_STATE);
+}
+
+void DepthPyramid::barrier(VkCommandBuffer cmd, const core::ImageState &next) {
+  VkImageMemoryBarrier2 imageBarrier =
+      core::ImageStateTracker::makeBarrier(_image.image, VK_IMAGE_ASPECT_COLOR_BIT, _state, next);
+  VkDependencyInfo depInfo = {};
+  depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  depInfo.imageMemoryBarrierCount = 1;
+  depInfo.pImageMemoryBarriers = &imageBarrier;
+  vkCmdPipelineBarrier2(cmd, &depInfo);
+
+  _state = next;
+}
+
+void DepthPyramid::releaseImage(core::DeletionQueue *retired) {
+  if (_image.image == VK_NULL_HANDLE) {
+    return;
+  }
+
+  _descriptorCache->evict((uint64_t)_image.imageView, retired);
+  for (VkImageView view : _levelViews) {
+    _descriptorCache->evict((uint64_t)view, retired);
+  }
+
+  auto destroy = [device = _device, image = _image, levelViews = std::move(_levelViews)]() {
+    for (VkImageView view : levelViews) {
+      vkDestroyImageView(device->device(), view, nullptr);
+    }
+    vkDestroyImageView(device->device(), image.imageView, nullptr);
+    vmaDestroyImage(device->allocator(), image.image, image.allocation);
+  };
+
+  if (retired) {
+    retired->push_back(std::move(destroy));
+  } else {
+    destroy();
+  }
+
+  _image = {};
+  _levelViews.clear();
+}
+
+} // namespace rendering
+} // namespace bisky
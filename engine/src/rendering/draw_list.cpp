@@ -0,0 +1,202 @@
+#include "rendering/draw_list.h"
+
+namespace bisky {
+namespace rendering {
+
+namespace {
+
+constexpr uint64_t PASS_BITS = 2;
+constexpr uint64_t PIPELINE_BITS = 10;
+constexpr uint64_t MATERIAL_BITS = 20;
+constexpr uint64_t INDEX_BUFFER_BITS = 16;
+constexpr uint64_t SURFACE_BITS = 16;
+
+constexpr uint64_t mask(uint64_t bits) { return (uint64_t(1) << bits) - 1; }
+
+// the index range an object draws at a level of detail
+MeshLod indexRange(const GPUObject &object, uint32_t level) {
+  return level < object.lods.size() ? object.lods[level] : MeshLod{object.firstIndex, object.indexCount, 0.0f};
+}
+
+bool sameSurface(const GPUObject &a, uint32_t levelA, const GPUObject &b, uint32_t levelB) {
+  const MeshLod rangeA = indexRange(a, levelA);
+  const MeshLod rangeB = indexRange(b, levelB);
+  return a.material == b.material && a.indexBuffer == b.indexBuffer && rangeA.firstIndex == rangeB.firstIndex &&
+         rangeA.indexCount == rangeB.indexCount && a.vertexBufferAddress == b.vertexBufferAddress;
+}
+
+} // namespace
+
+void DrawList::build(const RenderContext &context, std::span<const uint32_t> visible,
+                     std::span<const uint8_t> levels) {
+  _context = &context;
+  _entries.resize(visible.size());
+
+  for (size_t i = 0; i < visible.size(); i++) {
+    const uint32_t level = levels.empty() ? 0 : levels[i];
+    _entries[i] = SortEntry{.key = makeKey(context.objects[visible[i]], level), .index = visible[i], .level = level};
+  }
+
+  radixSort(_entries, _scratch);
+}
+
+void DrawList::clear() {
+  _context = nullptr;
+  _entries.clear();
+  _batches.clear();
+  _pipelineIds.clear();
+  _materialIds.clear();
+  _indexBufferIds.clear();
+  _surfaceIds.clear();
+}
+
+uint64_t DrawList::makeKey(const GPUObject &object, uint32_t level) {
+  const MaterialInstance &material = *object.material;
+
+  uint64_t pass = static_cast<uint64_t>(material.passType) & mask(PASS_BITS);
+  uint64_t pipeline = resourceId(_pipelineIds, (uint64_t)material.pipeline->pipeline) & mask(PIPELINE_BITS);
+  uint64_t materialId = resourceId(_materialIds, (uint64_t)&material) & mask(MATERIAL_BITS);
+  uint64_t indexBuffer = resourceId(_indexBufferIds, (uint64_t)object.indexBuffer) & mask(INDEX_BUFFER_BITS);
+  uint64_t surface =
+      resourceId(_surfaceIds, (uint64_t)object.indexBuffer * 31 + indexRange(object, level).firstIndex) &
+      mask(SURFACE_BITS);
+
+  return (pass << (PIPELINE_BITS + MATERIAL_BITS + INDEX_BUFFER_BITS + SURFACE_BITS)) |
+         (pipeline << (MATERIAL_BITS + INDEX_BUFFER_BITS + SURFACE_BITS)) |
+         (materialId << (INDEX_BUFFER_BITS + SURFACE_BITS)) | (indexBuffer << SURFACE_BITS) | surface;
+}
+
+uint32_t DrawList::resourceId(std::unordered_map<uint64_t, uint32_t> &ids, uint64_t handle) {
+  auto it = ids.find(handle);
+  if (it != ids.end()) {
+    return it->second;
+  }
+
+  uint32_t id = static_cast<uint32_t>(ids.size());
+  ids.emplace(handle, id);
+  return id;
+}
+
+/**
+ * LSD radix sort over the 8 bytes of the key. Passes whose byte is identical for every entry are skipped, which is the
+ * common case for the high bytes.
+ */
+void DrawList::radixSort(Vector<SortEntry> &entries, Vector<SortEntry> &scratch) {
+  const size_t count = entries.size();
+  if (count < 2) {
+    return;
+  }
+
+  scratch.resize(count);
+
+  for (uint32_t pass = 0; pass < 8; pass++) {
+    const uint32_t shift = pass * 8;
+
+    std::array<uint32_t, 256> histogram = {};
+    for (const SortEntry &entry : entries) {
+      histogram[(entry.key >> shift) & 0xff]++;
+    }
+
+    if (histogram[(entries[0].key >> shift) & 0xff] == count) {
+      continue;
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t &bucket : histogram) {
+      uint32_t size = bucket;
+      bucket = offset;
+      offset += size;
+    }
+
+    for (const SortEntry &entry : entries) {
+      scratch[histogram[(entry.key >> shift) & 0xff]++] = entry;
+    }
+
+    entries.swap(scratch);
+  }
+}
+
+uint32_t DrawList::prepare(GPURingBuffer &instanceRing) {
+  _batches.clear();
+  _instanceData = nullptr;
+  _instanceAddress = 0;
+  if (!_context || _entries.empty()) {
+    return 0;
+  }
+
+  GPURingBuffer::Allocation instances = instanceRing.allocate(_entries.size() * sizeof(GPUInstanceData));
+  _instanceData = static_cast<GPUInstanceData *>(instances.data);
+  _instanceAddress = instanceRing.deviceAddress() + instances.offset;
+
+  // extend each batch over every following object drawing the same surface
+  uint32_t first = 0;
+  while (first < _entries.size()) {
+    const GPUObject &object = _context->objects[_entries[first].index];
+
+    uint32_t last = first + 1;
+    while (last < _entries.size() && sameSurface(object, _entries[first].level,
+                                                 _context->objects[_entries[last].index], _entries[last].level)) {
+      last++;
+    }
+
+    _batches.push_back(Batch{first, last - first});
+    first = last;
+  }
+
+  return static_cast<uint32_t>(_batches.size());
+}
+
+DrawList::Stats DrawList::record(VkCommandBuffer cmd, uint32_t firstBatch, uint32_t batchCount,
+                                 VkDescriptorSet textureSet, VkDescriptorSet sceneSet, uint32_t sceneOffset) const {
+  Stats stats = {};
+
+  VkPipeline lastPipeline = VK_NULL_HANDLE;
+  VkBuffer lastIndexBuffer = VK_NULL_HANDLE;
+
+  for (uint32_t b = firstBatch; b < firstBatch + batchCount; b++) {
+    const Batch &batch = _batches[b];
+    const GPUObject &object = _context->objects[_entries[batch.firstEntry].index];
+    const MaterialInstance &material = *object.material;
+    const MaterialPipeline &pipeline = *material.pipeline;
+
+    if (pipeline.pipeline != lastPipeline) {
+      lastPipeline = pipeline.pipeline;
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+      stats.pipelineBinds++;
+
+      // a new pipeline may use a different layout, so rebind the sets
+      const VkDescriptorSet sets[] = {textureSet, sceneSet};
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 0, 2, sets, 1, &sceneOffset);
+      stats.descriptorBinds++;
+    }
+
+    if (object.indexBuffer != lastIndexBuffer) {
+      lastIndexBuffer = object.indexBuffer;
+      vkCmdBindIndexBuffer(cmd, object.indexBuffer, 0, object.indexType);
+      stats.indexBufferBinds++;
+    }
+
+    for (uint32_t i = batch.firstEntry; i < batch.firstEntry + batch.instanceCount; i++) {
+      _instanceData[i] = GPUInstanceData{
+          .worldMatrix = _context->objects[_entries[i].index].transform,
+          .textureIndex = material.textureIndex,
+          .samplerIndex = material.samplerIndex,
+      };
+    }
+
+    GPUPushConstants pushConstants = {};
+    pushConstants.instanceBuffer = _instanceAddress + batch.firstEntry * sizeof(GPUInstanceData);
+    pushConstants.vertexBuffer = object.vertexBufferAddress;
+    vkCmdPushConstants(cmd, pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+    const MeshLod range = indexRange(object, _entries[batch.firstEntry].level);
+    vkCmdDrawIndexed(cmd, range.indexCount, batch.instanceCount, range.firstIndex, 0, 0);
+    stats.draws++;
+    stats.instances += batch.instanceCount;
+  }
+
+  return stats;
+}
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,33 @@
+#include "rendering/frame_pacer.h"
+#include "core/cpu_profiler.h"
+
+#include <numeric>
+
+namespace bisky {
+namespace rendering {
+
+FramePacer::FramePacer(uint32_t frameCount)
+    : _frameCount(frameCount), _queuedFrames(frameCount), _submitTimes(frameCount, 0) {}
+
+void FramePacer::submitted(uint32_t frame) { _submitTimes[frame] = core::CpuProfiler::now(); }
+
+void FramePacer::completed(uint32_t frame) {
+  if (!_submitTimes[frame]) {
+    return;
+  }
+
+  _latencies[_count % HISTORY] = (core::CpuProfiler::now() - _submitTimes[frame]) / 1e6f;
+  _submitTimes[frame] = 0;
+  _count++;
+}
+
+float FramePacer::averageLatency() const {
+  const uint32_t samples = std::min(_count, HISTORY);
+  if (!samples) {
+    return 0.0f;
+  }
+  return std::accumulate(_latencies.begin(), _latencies.begin() + samples, 0.0f) / samples;
+}
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,167 @@
+#include "rendering/frustum_culler.h"
+#include "utils/utils.h"
+#include <bit>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define BISKY_CULL_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BISKY_CULL_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BISKY_CULL_NEON
+#endif
+
+namespace bisky {
+namespace rendering {
+
+namespace {
+
+#if defined(BISKY_CULL_AVX)
+constexpr uint32_t LANES = 8;
+#elif defined(BISKY_CULL_SSE) || defined(BISKY_CULL_NEON)
+constexpr uint32_t LANES = 4;
+#else
+constexpr uint32_t LANES = 1;
+#endif
+
+/**
+ * Returns a bitmask of the boxes in [first, first + LANES) that are at least partially inside all six planes.
+ * A box is outside a plane when dot(n, center) + w + dot(|n|, extents) < 0.
+ */
+uint32_t testLanes(const float *cx, const float *cy, const float *cz, const float *ex, const float *ey, const float *ez,
+                   const std::array<glm::vec4, 6> &planes) {
+#if defined(BISKY_CULL_AVX)
+  __m256 x = _mm256_loadu_ps(cx);
+  __m256 y = _mm256_loadu_ps(cy);
+  __m256 z = _mm256_loadu_ps(cz);
+  __m256 sx = _mm256_loadu_ps(ex);
+  __m256 sy = _mm256_loadu_ps(ey);
+  __m256 sz = _mm256_loadu_ps(ez);
+
+  __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  for (const glm::vec4 &plane : planes) {
+    __m256 distance = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+        _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+    __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, _mm256_set1_ps(std::abs(plane.x))),
+                                                _mm256_mul_ps(sy, _mm256_set1_ps(std::abs(plane.y)))),
+                                  _mm256_mul_ps(sz, _mm256_set1_ps(std::abs(plane.z))));
+
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+  }
+
+  return static_cast<uint32_t>(_mm256_movemask_ps(inside));
+#elif defined(BISKY_CULL_SSE)
+  __m128 x = _mm_loadu_ps(cx);
+  __m128 y = _mm_loadu_ps(cy);
+  __m128 z = _mm_loadu_ps(cz);
+  __m128 sx = _mm_loadu_ps(ex);
+  __m128 sy = _mm_loadu_ps(ey);
+  __m128 sz = _mm_loadu_ps(ez);
+
+  __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+  for (const glm::vec4 &plane : planes) {
+    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                                 _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+    __m128 radius = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(sx, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(sy, _mm_set1_ps(std::abs(plane.y)))),
+        _mm_mul_ps(sz, _mm_set1_ps(std::abs(plane.z))));
+
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+  }
+
+  return static_cast<uint32_t>(_mm_movemask_ps(inside));
+#elif defined(BISKY_CULL_NEON)
+  float32x4_t x = vld1q_f32(cx);
+  float32x4_t y = vld1q_f32(cy);
+  float32x4_t z = vld1q_f32(cz);
+  float32x4_t sx = vld1q_f32(ex);
+  float32x4_t sy = vld1q_f32(ey);
+  float32x4_t sz = vld1q_f32(ez);
+
+  uint32x4_t inside = vdupq_n_u32(0xffffffff);
+  for (const glm::vec4 &plane : planes) {
+    float32x4_t distance = vaddq_f32(vaddq_f32(vmulq_n_f32(x, plane.x), vmulq_n_f32(y, plane.y)),
+                                     vaddq_f32(vmulq_n_f32(z, plane.z), vdupq_n_f32(plane.w)));
+    float32x4_t radius = vaddq_f32(vaddq_f32(vmulq_n_f32(sx, std::abs(plane.x)), vmulq_n_f32(sy, std::abs(plane.y))),
+                                   vmulq_n_f32(sz, std::abs(plane.z)));
+
+    inside = vandq_u32(inside, vcgeq_f32(vaddq_f32(distance, radius), vdupq_n_f32(0.0f)));
+  }
+
+  uint32_t lanes[4];
+  vst1q_u32(lanes, inside);
+  return (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
+#else
+  for (const glm::vec4 &plane : planes) {
+    float distance = cx[0] * plane.x + cy[0] * plane.y + cz[0] * plane.z + plane.w;
+    float radius = ex[0] * std::abs(plane.x) + ey[0] * std::abs(plane.y) + ez[0] * std::abs(plane.z);
+    if (distance + radius < 0.0f) {
+      return 0;
+    }
+  }
+
+  return 1;
+#endif
+}
+
+} // namespace
+
+uint32_t FrustumCuller::lanes() { return LANES; }
+
+void FrustumCuller::gatherBounds(const RenderContext &context) {
+  const size_t count = context.objects.size();
+  const size_t padded = (count + LANES - 1) / LANES * LANES;
+
+  // the padding lanes are tested too, their results are discarded in cull()
+  for (Vector<float> *array : {&_centerX, &_centerY, &_centerZ, &_extentX, &_extentY, &_extentZ}) {
+    array->assign(padded, 0.0f);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    const GPUObject &object = context.objects[i];
+    const glm::mat4 &m = object.transform;
+
+    // transform the local box to a world space box enclosing it
+    glm::vec3 center = glm::vec3(m * glm::vec4(object.bounds.origin, 1.0f));
+    glm::vec3 e = object.bounds.extents;
+    glm::vec3 extents = glm::abs(glm::vec3(m[0])) * e.x + glm::abs(glm::vec3(m[1])) * e.y +
+                        glm::abs(glm::vec3(m[2])) * e.z;
+
+    _centerX[i] = center.x;
+    _centerY[i] = center.y;
+    _centerZ[i] = center.z;
+    _extentX[i] = extents.x;
+    _extentY[i] = extents.y;
+    _extentZ[i] = extents.z;
+  }
+}
+
+const Vector<uint32_t> &FrustumCuller::cull(const RenderContext &context, const glm::mat4 &viewproj) {
+  _visible.clear();
+  gatherBounds(context);
+
+  const std::array<glm::vec4, 6> planes = utils::extractFrustumPlanes(viewproj);
+  const uint32_t count = static_cast<uint32_t>(context.objects.size());
+
+  for (uint32_t first = 0; first < count; first += LANES) {
+    uint32_t mask = testLanes(&_centerX[first], &_centerY[first], &_centerZ[first], &_extentX[first],
+                              &_extentY[first], &_extentZ[first], planes);
+
+    while (mask) {
+      uint32_t lane = std::countr_zero(mask);
+      mask &= mask - 1;
+
+      if (first + lane < count) {
+        _visible.push_back(first + lane);
+      }
+    }
+  }
+
+  return _visible;
+}
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,168 @@
+#include "rendering/gpu_profiler.h"
+#include "core/device.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace bisky {
+namespace rendering {
+
+namespace {
+
+uint64_t timestampMask(uint32_t validBits) {
+  return validBits >= 64 ? UINT64_MAX : (uint64_t(1) << validBits) - 1;
+}
+
+} // namespace
+
+float GpuProfiler::Timing::average() const {
+  if (!count) {
+    return 0.0f;
+  }
+  return std::accumulate(history.begin(), history.begin() + samples(), 0.0f) / samples();
+}
+
+float GpuProfiler::Timing::min() const {
+  return count ? *std::min_element(history.begin(), history.begin() + samples()) : 0.0f;
+}
+
+float GpuProfiler::Timing::max() const {
+  return count ? *std::max_element(history.begin(), history.begin() + samples()) : 0.0f;
+}
+
+GpuProfiler::GpuProfiler(Pointer<core::Device> device, uint32_t frameCount) : _device(device) {
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(_device->physicalDevice(), &familyCount, nullptr);
+  Vector<VkQueueFamilyProperties> families(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(_device->physicalDevice(), &familyCount, families.data());
+
+  _graphicsMask = timestampMask(families[_device->queueFamily()].timestampValidBits);
+  _computeMask = timestampMask(families[_device->computeQueueFamily()].timestampValidBits);
+  _period = _device->properties().limits.timestampPeriod;
+  _supported = families[_device->queueFamily()].timestampValidBits > 0;
+  _enabled = _supported;
+
+  if (!_supported) {
+    return;
+  }
+
+  VkQueryPoolCreateInfo poolInfo = {.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = MAX_ZONES * 2;
+
+  _frames.resize(frameCount);
+  for (FrameQueries &frame : _frames) {
+    VK_CHECK(vkCreateQueryPool(_device->device(), &poolInfo, nullptr, &frame.pool));
+    vkResetQueryPool(_device->device(), frame.pool, 0, poolInfo.queryCount);
+  }
+}
+
+GpuProfiler::~GpuProfiler() {}
+
+void GpuProfiler::cleanup() {
+  for (FrameQueries &frame : _frames) {
+    vkDestroyQueryPool(_device->device(), frame.pool, nullptr);
+  }
+  _frames.clear();
+}
+
+void GpuProfiler::beginFrame(uint32_t frame) {
+  if (!_supported) {
+    return;
+  }
+
+  _frame = frame;
+  FrameQueries &queries = _frames[frame];
+  if (!queries.zones.empty()) {
+    // value and availability of every query, written queries of a waited on frame are always available
+    std::array<uint64_t, MAX_ZONES * 2 * 2> results;
+    const uint32_t queryCount = static_cast<uint32_t>(queries.zones.size()) * 2;
+    VkResult result = vkGetQueryPoolResults(_device->device(), queries.pool, 0, queryCount, sizeof(results),
+                                            results.data(), sizeof(uint64_t) * 2,
+                                            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    if (result == VK_SUCCESS || result == VK_NOT_READY) {
+      for (uint32_t i = 0; i < queries.zones.size(); i++) {
+        const uint64_t *begin = &results[i * 4];
+        const uint64_t *end = &results[i * 4 + 2];
+        if (!begin[1] || !end[1]) {
+          continue;
+        }
+
+        const uint64_t ticks = (end[0] - begin[0]) & queries.zones[i].mask;
+        record(queries.zones[i].name, static_cast<float>(ticks * _period / 1e6));
+      }
+    }
+
+    vkResetQueryPool(_device->device(), queries.pool, 0, queryCount);
+    queries.zones.clear();
+  }
+}
+
+uint32_t GpuProfiler::beginZone(VkCommandBuffer cmd, const std::string &name, bool compute) {
+  if (!_enabled || (compute && !_computeMask)) {
+    return INVALID_ZONE;
+  }
+
+  FrameQueries &queries = _frames[_frame];
+  if (queries.zones.size() == MAX_ZONES) {
+    return INVALID_ZONE;
+  }
+
+  const uint32_t zone = static_cast<uint32_t>(queries.zones.size());
+  queries.zones.push_back({name, compute ? _computeMask : _graphicsMask});
+  vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, queries.pool, zone * 2);
+
+  return zone;
+}
+
+void GpuProfiler::endZone(VkCommandBuffer cmd, uint32_t zone) {
+  if (zone == INVALID_ZONE) {
+    return;
+  }
+
+  vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, _frames[_frame].pool, zone * 2 + 1);
+}
+
+const GpuProfiler::Timing *GpuProfiler::timing(const std::string &name) {
+  auto it = _timingIds.find(name);
+  return it != _timingIds.end() ? &_timings[it->second] : nullptr;
+}
+
+void GpuProfiler::writeJson(const std::string &path) {
+  std::ofstream file(path);
+  if (!file) {
+    throw std::runtime_error("failed to open " + path);
+  }
+
+  file << "{\n  \"zones\": [";
+  for (uint32_t i = 0; i < _timings.size(); i++) {
+    const Timing &timing = _timings[i];
+    file << (i ? ",\n" : "\n");
+    file << fmt::format("    {{\"name\": \"{}\", \"samples\": {}, \"last_ms\": {:.4f}, \"average_ms\": {:.4f}, "
+                        "\"min_ms\": {:.4f}, \"max_ms\": {:.4f}, \"history_ms\": [",
+                        timing.name, timing.samples(), timing.last(), timing.average(), timing.min(), timing.max());
+
+    // oldest sample first
+    const uint32_t first = timing.count > HISTORY ? timing.count % HISTORY : 0;
+    for (uint32_t j = 0; j < timing.samples(); j++) {
+      file << fmt::format("{}{:.4f}", j ? ", " : "", timing.history[(first + j) % HISTORY]);
+    }
+    file << "]}";
+  }
+  file << "\n  ]\n}\n";
+}
+
+void GpuProfiler::record(const std::string &name, float milliseconds) {
+  auto [it, inserted] = _timingIds.try_emplace(name, static_cast<uint32_t>(_timings.size()));
+  if (inserted) {
+    _timings.push_back({.name = name});
+  }
+
+  Timing &timing = _timings[it->second];
+  timing.history[timing.count % HISTORY] = milliseconds;
+  timing.count++;
+}
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,530 @@
+#include "core/descriptor_writer.h"
+#include "core/descriptors.h"
+#include "core/device.h"
+#include "core/immedate_submit.h"
+#include "core/pipeline_builder.h"
+#include "utils/init.h"
+#include "utils/utils.h"
+
+#include "rendering/indirect_drawer.h"
+
+namespace bisky {
+namespace rendering {
+
+IndirectDrawer::IndirectDrawer(Pointer<core::Device> device, Pointer<core::ImmediateSubmit> immediateSubmit,
+                               Pointer<core::DescriptorCache> descriptorCache, uint32_t frameCount)
+    : _device(device), _immediateSubmit(immediateSubmit), _descriptorCache(descriptorCache), _frameCount(frameCount) {}
+
+IndirectDrawer::~IndirectDrawer() {}
+
+void IndirectDrawer::cleanup() {
+  releaseBuffers();
+  _deletionQueue.flush();
+}
+
+void IndirectDrawer::releaseBuffers() {
+  for (std::optional<GPUBuffer> *buffer : {&_recordBuffer, &_lodBuffer, &_meshletBuffer, &_meshletVertexBuffer,
+                                           &_meshletTriangleBuffer, &_clusterCommandTemplate, &_visibilityBuffer}) {
+    if (*buffer) {
+      _descriptorCache->evict((uint64_t)(*buffer)->buffer);
+      (*buffer)->cleanup(_device->allocator());
+      buffer->reset();
+    }
+  }
+
+  for (auto &frame : _frames) {
+    for (GPUBuffer *buffer : {&frame.commandBuffer, &frame.countBuffer, &frame.lateCommandBuffer,
+                              &frame.lateCountBuffer, &frame.occlusionBuffer, &frame.clusterCommandBuffer,
+                              &frame.clusterIndexBuffer}) {
+      _descriptorCache->evict((uint64_t)buffer->buffer);
+    }
+    frame.commandBuffer.cleanup(_device->allocator());
+    frame.countBuffer.cleanup(_device->allocator());
+    frame.clusterCommandBuffer.cleanup(_device->allocator());
+    frame.clusterIndexBuffer.cleanup(_device->allocator());
+    frame.lateCommandBuffer.cleanup(_device->allocator());
+    frame.lateCountBuffer.cleanup(_device->allocator());
+    frame.occlusionBuffer.cleanup(_device->allocator());
+  }
+  _frames.clear();
+}
+
+GPUBuffer IndirectDrawer::uploadBuffer(const void *data, size_t size, VkBufferUsageFlags usage,
+                                       VkPipelineStageFlags2 stages, VkAccessFlags2 access) {
+  GPUBuffer::Builder builder = {};
+  GPUBuffer buffer = builder.build(_device->allocator(), size,
+                                   usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                   VMA_MEMORY_USAGE_GPU_ONLY);
+
+  GPUBuffer staging =
+      builder.build(_device->allocator(), size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+  memcpy(staging.info.pMappedData, data, size);
+
+  const core::ImmediateSubmit::BufferUpload uploads[] = {{buffer.buffer, stages, access}};
+  _immediateSubmit->upload(
+      [&](VkCommandBuffer cmd) {
+        VkBufferCopy copy = {};
+        copy.size = size;
+        vkCmdCopyBuffer(cmd, staging.buffer, buffer.buffer, 1, &copy);
+      },
+      uploads, {}, [allocator = _device->allocator(), staging]() mutable { staging.cleanup(allocator); });
+
+  return buffer;
+}
+
+void IndirectDrawer::buildPipelines(Slang::ComPtr<slang::ISession> session, VkFormat colorFormat,
+                                    VkFormat depthFormat) {
+  // cull pipeline
+  {
+    core::DescriptorLayoutBuilder builder;
+    _cullDescriptorLayout = builder.add(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                                .add(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                                .add(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                                .add(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                                .add(4, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+                                .add(5, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE)
+                                .add(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                                .build(_device->device(), VK_SHADER_STAGE_COMPUTE_BIT, nullptr,
+                                       _descriptorCache->layoutFlags());
+  }
+
+  VkPushConstantRange cullRange = {};
+  cullRange.offset = 0;
+  cullRange.size = sizeof(GPUCullPushConstants);
+  cullRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo cullLayoutInfo = init::pipelineLayoutCreateInfo();
+  cullLayoutInfo.setLayoutCount = 1;
+  cullLayoutInfo.pSetLayouts = &_cullDescriptorLayout;
+  cullLayoutInfo.pushConstantRangeCount = 1;
+  cullLayoutInfo.pPushConstantRanges = &cullRange;
+  VK_CHECK(vkCreatePipelineLayout(_device->device(), &cullLayoutInfo, nullptr, &_cullPipelineLayout));
+
+  slang::IModule *cullModule = utils::createSlangModule(session, "../resources/shaders/compute/cull.slang");
+  VkShaderModule cullShader;
+  if (!utils::loadShaderModule(session, cullModule, _device->device(), "cullMain", &cullShader)) {
+    throw std::runtime_error("failed to create cull shader module");
+  }
+
+  VkComputePipelineCreateInfo computePipelineCreateInfo = {};
+  computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  computePipelineCreateInfo.flags = _descriptorCache->pipelineFlags();
+  computePipelineCreateInfo.layout = _cullPipelineLayout;
+  computePipelineCreateInfo.stage = init::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, cullShader);
+  VK_CHECK(vkCreateComputePipelines(_device->device(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr,
+                                    &_cullPipeline));
+
+  vkDestroyShaderModule(_device->device(), cullShader, nullptr);
+
+  // cluster cull pipeline
+  {
+    core::DescriptorLayoutBuilder builder;
+    _clusterDescriptorLayout = builder.add(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                                   .add(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                                   .add(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                                   .add(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                                   .add(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                                   .build(_device->device(), VK_SHADER_STAGE_COMPUTE_BIT, nullptr,
+                                          _descriptorCache->layoutFlags());
+  }
+
+  VkPipelineLayoutCreateInfo clusterLayoutInfo = cullLayoutInfo;
+  clusterLayoutInfo.pSetLayouts = &_clusterDescriptorLayout;
+  VK_CHECK(vkCreatePipelineLayout(_device->device(), &clusterLayoutInfo, nullptr, &_clusterPipelineLayout));
+
+  slang::IModule *clusterModule =
+      utils::createSlangModule(session, "../resources/shaders/compute/cluster_cull.slang");
+  VkShaderModule clusterShader;
+  if (!utils::loadShaderModule(session, clusterModule, _device->device(), "clusterCullMain", &clusterShader)) {
+    throw std::runtime_error("failed to create cluster cull shader module");
+  }
+
+  computePipelineCreateInfo.layout = _clusterPipelineLayout;
+  computePipelineCreateInfo.stage = init::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, clusterShader);
+  VK_CHECK(vkCreateComputePipelines(_device->device(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr,
+                                    &_clusterPipeline));
+
+  vkDestroyShaderModule(_device->device(), clusterShader, nullptr);
+
+  // draw pipeline
+  VkPushConstantRange drawRange = {};
+  drawRange.offset = 0;
+  drawRange.size = sizeof(GPUIndirectPushConstants);
+  drawRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  VkPipelineLayoutCreateInfo drawLayoutInfo = init::pipelineLayoutCreateInfo();
+  drawLayoutInfo.pushConstantRangeCount = 1;
+  drawLayoutInfo.pPushConstantRanges = &drawRange;
+  VK_CHECK(vkCreatePipelineLayout(_device->device(), &drawLayoutInfo, nullptr, &_drawPipelineLayout));
+
+  slang::IModule *meshModule = utils::createSlangModule(session, "../resources/shaders/render/indirect_mesh.slang");
+  VkShaderModule vertShader;
+  VkShaderModule compactVertShader;
+  VkShaderModule fragShader;
+  if (!utils::loadShaderModule(session, meshModule, _device->device(), "vertMain", &vertShader) ||
+      !utils::loadShaderModule(session, meshModule, _device->device(), "vertMainCompact", &compactVertShader) ||
+      !utils::loadShaderModule(session, meshModule, _device->device(), "fragMain", &fragShader)) {
+    throw std::runtime_error("failed to create indirect mesh shader modules");
+  }
+
+  core::PipelineBuilder builder;
+  builder.layout = _drawPipelineLayout;
+  _drawPipeline = builder.setShaders(vertShader, fragShader)
+                      .setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+                      .setPolygonMode(VK_POLYGON_MODE_FILL)
+                      .setCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE)
+                      .setMultisamplingNone()
+                      .disableBlending()
+                      .enableDepthTest(true, VK_COMPARE_OP_GREATER_OR_EQUAL)
+                      .setColorAttachmentFormat(colorFormat)
+                      .setDepthFormat(depthFormat)
+                      .build(_device->device());
+  _compactDrawPipeline = builder.setShaders(compactVertShader, fragShader).build(_device->device());
+
+  vkDestroyShaderModule(_device->device(), vertShader, nullptr);
+  vkDestroyShaderModule(_device->device(), compactVertShader, nullptr);
+  vkDestroyShaderModule(_device->device(), fragShader, nullptr);
+
+  _deletionQueue.push_back([&]() {
+    vkDestroyPipeline(_device->device(), _drawPipeline, nullptr);
+    vkDestroyPipeline(_device->device(), _compactDrawPipeline, nullptr);
+    vkDestroyPipelineLayout(_device->device(), _drawPipelineLayout, nullptr);
+    vkDestroyPipeline(_device->device(), _cullPipeline, nullptr);
+    vkDestroyPipelineLayout(_device->device(), _cullPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device->device(), _cullDescriptorLayout, nullptr);
+    vkDestroyPipeline(_device->device(), _clusterPipeline, nullptr);
+    vkDestroyPipelineLayout(_device->device(), _clusterPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device->device(), _clusterDescriptorLayout, nullptr);
+  });
+}
+
+void IndirectDrawer::upload(const Vector<Pointer<MeshAsset>> &meshes) {
+  releaseBuffers();
+  _records.clear();
+  _lods.clear();
+  _batches.clear();
+  _meshlets.clear();
+  _clusterCommands.clear();
+  _clusterIndexCount = 0;
+
+  Vector<uint32_t> meshletVertices;
+  Vector<uint32_t> meshletTriangles;
+
+  // one batch per index buffer, the surfaces of a batch own a contiguous range of the command buffer
+  for (const Pointer<MeshAsset> &mesh : meshes) {
+    Batch batch = {};
+    batch.indexBuffer = mesh->meshBuffers.indexBuffer.buffer;
+    batch.indexType = mesh->meshBuffers.indexType;
+    batch.firstDraw = static_cast<uint32_t>(_records.size());
+    batch.drawCount = static_cast<uint32_t>(mesh->surfaces.size());
+
+    for (const GeoSurface &surface : mesh->surfaces) {
+      GPUDrawRecord record = {};
+      record.sphere = glm::vec4(surface.bounds.origin, surface.bounds.sphereRadius);
+      record.indexCount = surface.count;
+      record.firstIndex = surface.startIndex;
+      record.batch = static_cast<uint32_t>(_batches.size());
+      record.commandOffset = batch.firstDraw;
+      record.vertexBuffer = mesh->meshBuffers.vertexBufferAddress;
+      record.firstLod = static_cast<uint32_t>(_lods.size());
+      record.lodCount = static_cast<uint32_t>(surface.lods.size());
+      record.compactVertexBuffer = mesh->meshBuffers.compactVertexBufferAddress;
+      record.positionOffset = glm::vec4(mesh->quantization.offset, 0.0f);
+      record.positionScale = glm::vec4(mesh->quantization.scale, 0.0f);
+      _records.push_back(record);
+      _lods.insert(_lods.end(), surface.lods.begin(), surface.lods.end());
+    }
+
+    // the batch's clusters get a contiguous range of the cluster index buffer, firstInstance points the vertex
+    // shader at the first record, whose vertex buffer all surfaces of the mesh share
+    VkDrawIndexedIndirectCommand command = {};
+    command.instanceCount = 1;
+    command.firstIndex = _clusterIndexCount;
+    command.firstInstance = batch.firstDraw;
+    _clusterCommands.push_back(command);
+
+    const MeshletData &data = mesh->meshlets;
+    for (const Meshlet &meshlet : data.meshlets) {
+      GPUMeshlet gpuMeshlet = {};
+      gpuMeshlet.sphere = glm::vec4(meshlet.center, meshlet.radius);
+      gpuMeshlet.cone = glm::vec4(meshlet.coneAxis, meshlet.coneCutoff);
+      gpuMeshlet.vertexOffset = static_cast<uint32_t>(meshletVertices.size()) + meshlet.vertexOffset;
+      gpuMeshlet.triangleOffset = static_cast<uint32_t>(meshletTriangles.size()) + meshlet.triangleOffset;
+      gpuMeshlet.triangleCount = meshlet.triangleCount;
+      gpuMeshlet.batch = static_cast<uint32_t>(_batches.size());
+      _meshlets.push_back(gpuMeshlet);
+
+      _clusterIndexCount += meshlet.triangleCount * 3;
+    }
+    meshletVertices.insert(meshletVertices.end(), data.vertices.begin(), data.vertices.end());
+    meshletTriangles.insert(meshletTriangles.end(), data.triangles.begin(), data.triangles.end());
+
+    _batches.push_back(batch);
+  }
+
+  if (_records.empty()) {
+    return;
+  }
+
+  _recordBuffer = uploadBuffer(_records.data(), _records.size() * sizeof(GPUDrawRecord),
+                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                               VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+                               VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+  VkBufferDeviceAddressInfo deviceAddressInfo = {};
+  deviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+  deviceAddressInfo.buffer = _recordBuffer->buffer;
+  _recordBufferAddress = vkGetBufferDeviceAddress(_device->device(), &deviceAddressInfo);
+
+  // never empty, so the bindings always have a buffer
+  const MeshLod noLod = {};
+  const GPUMeshlet noMeshlet = {};
+  const uint32_t noIndex = 0;
+  auto storage = [&](const void *data, size_t size, const void *fallback, size_t fallbackSize) {
+    return uploadBuffer(size ? data : fallback, size ? size : fallbackSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+  };
+  _lodBuffer = storage(_lods.data(), _lods.size() * sizeof(MeshLod), &noLod, sizeof(noLod));
+  _meshletBuffer = storage(_meshlets.data(), _meshlets.size() * sizeof(GPUMeshlet), &noMeshlet, sizeof(noMeshlet));
+  _meshletVertexBuffer = storage(meshletVertices.data(), meshletVertices.size() * sizeof(uint32_t), &noIndex,
+                                 sizeof(noIndex));
+  _meshletTriangleBuffer = storage(meshletTriangles.data(), meshletTriangles.size() * sizeof(uint32_t), &noIndex,
+                                   sizeof(noIndex));
+
+  // nothing was visible before the first frame, so everything is tested against the pyramid once
+  const Vector<uint32_t> visibility(_records.size(), 0);
+  _visibilityBuffer = uploadBuffer(visibility.data(), visibility.size() * sizeof(uint32_t),
+                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                   VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  const size_t clusterCommandBufferSize = _clusterCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+  _clusterCommandTemplate = uploadBuffer(_clusterCommands.data(), clusterCommandBufferSize,
+                                         VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_PIPELINE_STAGE_2_COPY_BIT,
+                                         VK_ACCESS_2_TRANSFER_READ_BIT);
+
+  const size_t commandBufferSize = _records.size() * sizeof(VkDrawIndexedIndirectCommand);
+  const size_t countBufferSize = _batches.size() * sizeof(uint32_t);
+  const size_t clusterIndexBufferSize = std::max<size_t>(_clusterIndexCount, 1) * sizeof(uint32_t);
+
+  // descriptor buffers reference the bound buffers by device address
+  const VkBufferUsageFlags storageUsage =
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+  const VkBufferUsageFlags uniformUsage =
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+  GPUBuffer::Builder builder = {};
+  for (uint32_t i = 0; i < _frameCount; i++) {
+    _frames.push_back(FrameResources{
+        .commandBuffer = builder.build(_device->allocator(), commandBufferSize,
+                                       storageUsage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                       VMA_MEMORY_USAGE_GPU_ONLY),
+        .countBuffer = builder.build(_device->allocator(), countBufferSize,
+                                     storageUsage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                         VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                     VMA_MEMORY_USAGE_GPU_ONLY),
+        .lateCommandBuffer = builder.build(_device->allocator(), commandBufferSize,
+                                           storageUsage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                           VMA_MEMORY_USAGE_GPU_ONLY),
+        .lateCountBuffer = builder.build(_device->allocator(), countBufferSize,
+                                         storageUsage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VMA_MEMORY_USAGE_GPU_ONLY),
+        .occlusionBuffer = builder.build(_device->allocator(), sizeof(GPUOcclusionData),
+                                         uniformUsage, VMA_MEMORY_USAGE_CPU_TO_GPU),
+        .clusterCommandBuffer = builder.build(_device->allocator(), clusterCommandBufferSize,
+                                              storageUsage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                              VMA_MEMORY_USAGE_GPU_ONLY),
+        .clusterIndexBuffer = builder.build(_device->allocator(), clusterIndexBufferSize,
+                                            storageUsage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                            VMA_MEMORY_USAGE_GPU_ONLY),
+    });
+  }
+}
+
+void IndirectDrawer::cull(VkCommandBuffer cmd, uint32_t frame, const glm::mat4 &viewproj,
+                          const glm::vec3 &cameraPosition, float lodScale, DepthPyramid &pyramid) {
+  if (_records.empty()) {
+    return;
+  }
+
+  FrameResources &resources = _frames[frame];
+
+  GPUCullPushConstants &pushConstants = resources.pushConstants;
+  pushConstants = {};
+  std::array<glm::vec4, 6> planes = utils::extractFrustumPlanes(viewproj);
+  std::copy(planes.begin(), planes.end(), pushConstants.planes);
+  pushConstants.camera = glm::vec4(cameraPosition, lodScale);
+  pushConstants.drawCount = drawCount();
+  resources.viewproj = viewproj;
+
+  // clusters are only frustum and cone culled
+  resources.occlusion = _occlusionCulling && !_clusterCulling;
+
+  if (_clusterCulling) {
+    GPUCullPushConstants clusterPushConstants = pushConstants;
+    clusterPushConstants.drawCount = meshletCount();
+    cullClusters(cmd, resources, clusterPushConstants);
+    return;
+  }
+
+  // the late pass of the previous frame wrote the visibility this phase reads
+  if (resources.occlusion) {
+    utils::bufferBarrier(cmd, _visibilityBuffer->buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+  }
+
+  pushConstants.phase = static_cast<uint32_t>(resources.occlusion ? CullPhase::EARLY : CullPhase::ALL);
+  dispatchCull(cmd, resources, pyramid, resources.commandBuffer, resources.countBuffer);
+}
+
+void IndirectDrawer::cullLate(VkCommandBuffer cmd, uint32_t frame, DepthPyramid &pyramid) {
+  if (_records.empty() || !_frames[frame].occlusion) {
+    return;
+  }
+
+  FrameResources &resources = _frames[frame];
+
+  // written while recording, the frame's fence guarantees the previous reader is done
+  GPUOcclusionData *occlusion = static_cast<GPUOcclusionData *>(resources.occlusionBuffer.info.pMappedData);
+  occlusion->viewproj = resources.viewproj;
+  occlusion->pyramidSize = glm::vec2(pyramid.size().width, pyramid.size().height);
+  occlusion->pyramidLevels = pyramid.levelCount();
+
+  // the early phase has to be done reading the visibility before it is rewritten
+  utils::bufferBarrier(cmd, _visibilityBuffer->buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  resources.pushConstants.phase = static_cast<uint32_t>(CullPhase::LATE);
+  dispatchCull(cmd, resources, pyramid, resources.lateCommandBuffer, resources.lateCountBuffer);
+}
+
+void IndirectDrawer::dispatchCull(VkCommandBuffer cmd, FrameResources &resources, DepthPyramid &pyramid,
+                                  const GPUBuffer &commandBuffer, const GPUBuffer &countBuffer) {
+  // reset the per batch draw counts
+  vkCmdFillBuffer(cmd, countBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+  utils::bufferBarrier(cmd, countBuffer.buffer, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                       VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  // the same buffers and pyramid every frame, so this is a cache hit after the first frames with pools
+  core::DescriptorWriter writer;
+  writer.writeBuffer(0, *_recordBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.writeBuffer(1, commandBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.writeBuffer(2, countBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.writeBuffer(3, *_lodBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.writeBuffer(4, resources.occlusionBuffer.buffer, sizeof(GPUOcclusionData), 0,
+                     VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+  writer.writeImage(5, pyramid.view(), VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+  writer.writeBuffer(6, *_visibilityBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+  _descriptorCache->bind(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout, 0, _cullDescriptorLayout, writer);
+  vkCmdPushConstants(cmd, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUCullPushConstants),
+                     &resources.pushConstants);
+  vkCmdDispatch(cmd, (drawCount() + 63) / 64, 1, 1);
+
+  // make the compacted commands and counts visible to the indirect draw
+  utils::bufferBarrier(cmd, commandBuffer.buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+                       VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+  utils::bufferBarrier(cmd, countBuffer.buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+                       VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+}
+
+void IndirectDrawer::cullClusters(VkCommandBuffer cmd, FrameResources &resources,
+                                  const GPUCullPushConstants &pushConstants) {
+  // reset the index counts of the per batch commands
+  VkBufferCopy copy = {};
+  copy.size = _clusterCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+  vkCmdCopyBuffer(cmd, _clusterCommandTemplate->buffer, resources.clusterCommandBuffer.buffer, 1, &copy);
+  utils::bufferBarrier(cmd, resources.clusterCommandBuffer.buffer, VK_PIPELINE_STAGE_2_COPY_BIT,
+                       VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+  if (!pushConstants.drawCount) {
+    return;
+  }
+
+  core::DescriptorWriter writer;
+  writer.writeBuffer(0, *_meshletBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.writeBuffer(1, *_meshletVertexBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.writeBuffer(2, *_meshletTriangleBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.writeBuffer(3, resources.clusterCommandBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  writer.writeBuffer(4, resources.clusterIndexBuffer, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _clusterPipeline);
+  _descriptorCache->bind(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _clusterPipelineLayout, 0, _clusterDescriptorLayout,
+                         writer);
+  vkCmdPushConstants(cmd, _clusterPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants),
+                     &pushConstants);
+
+  // one workgroup per meshlet, spread over y past the guaranteed workgroup count limit
+  const uint32_t maxGroups = 65535;
+  const uint32_t groupsX = std::min(pushConstants.drawCount, maxGroups);
+  const uint32_t groupsY = (pushConstants.drawCount + maxGroups - 1) / maxGroups;
+  vkCmdDispatch(cmd, groupsX, groupsY, 1);
+
+  utils::bufferBarrier(cmd, resources.clusterCommandBuffer.buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+                       VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+  utils::bufferBarrier(cmd, resources.clusterIndexBuffer.buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT,
+                       VK_ACCESS_2_INDEX_READ_BIT);
+}
+
+void IndirectDrawer::draw(VkCommandBuffer cmd, uint32_t frame, const glm::mat4 &viewproj, VkDeviceAddress sceneData) {
+  if (_records.empty()) {
+    return;
+  }
+
+  FrameResources &resources = _frames[frame];
+  bindDrawPipeline(cmd, viewproj, sceneData);
+
+  if (_clusterCulling) {
+    vkCmdBindIndexBuffer(cmd, resources.clusterIndexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdDrawIndexedIndirect(cmd, resources.clusterCommandBuffer.buffer, 0,
+                             static_cast<uint32_t>(_clusterCommands.size()), sizeof(VkDrawIndexedIndirectCommand));
+    return;
+  }
+
+  drawBatches(cmd, resources.commandBuffer, resources.countBuffer);
+}
+
+void IndirectDrawer::drawLate(VkCommandBuffer cmd, uint32_t frame, const glm::mat4 &viewproj,
+                              VkDeviceAddress sceneData) {
+  if (_records.empty() || !_frames[frame].occlusion) {
+    return;
+  }
+
+  bindDrawPipeline(cmd, viewproj, sceneData);
+  drawBatches(cmd, _frames[frame].lateCommandBuffer, _frames[frame].lateCountBuffer);
+}
+
+void IndirectDrawer::bindDrawPipeline(VkCommandBuffer cmd, const glm::mat4 &viewproj, VkDeviceAddress sceneData) {
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _compactVertices ? _compactDrawPipeline : _drawPipeline);
+
+  GPUIndirectPushConstants pushConstants = {};
+  pushConstants.viewproj = viewproj;
+  pushConstants.drawRecords = _recordBufferAddress;
+  pushConstants.sceneData = sceneData;
+  vkCmdPushConstants(cmd, _drawPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                     sizeof(pushConstants), &pushConstants);
+}
+
+void IndirectDrawer::drawBatches(VkCommandBuffer cmd, const GPUBuffer &commandBuffer, const GPUBuffer &countBuffer) {
+  for (uint32_t i = 0; i < _batches.size(); i++) {
+    const Batch &batch = _batches[i];
+
+    vkCmdBindIndexBuffer(cmd, batch.indexBuffer, 0, batch.indexType);
+    vkCmdDrawIndexedIndirectCount(cmd, commandBuffer.buffer, batch.firstDraw * sizeof(VkDrawIndexedIndirectCommand),
+                                  countBuffer.buffer, i * sizeof(uint32_t), batch.drawCount,
+                                  sizeof(VkDrawIndexedIndirectCommand));
+  }
+}
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,111 @@
+#include "rendering/light_culler.h"
+#include "core/device.h"
+#include "utils/init.h"
+#include "utils/utils.h"
+
+#include <cmath>
+
+namespace bisky {
+namespace rendering {
+
+LightCuller::LightCuller(Pointer<core::Device> device, uint32_t frameCount) : _device(device) {
+  const size_t clusterBufferSize = CLUSTER_COUNT * (MAX_LIGHTS_PER_CLUSTER + 1) * sizeof(uint32_t);
+
+  GPUBuffer::Builder builder = {};
+  for (uint32_t i = 0; i < frameCount; i++) {
+    _clusterBuffers.push_back(builder.build(_device->allocator(), clusterBufferSize,
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                            VMA_MEMORY_USAGE_GPU_ONLY));
+
+    VkBufferDeviceAddressInfo deviceAddressInfo = {};
+    deviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    deviceAddressInfo.buffer = _clusterBuffers.back().buffer;
+    _clusterAddresses.push_back(vkGetBufferDeviceAddress(_device->device(), &deviceAddressInfo));
+  }
+}
+
+LightCuller::~LightCuller() {}
+
+void LightCuller::cleanup() {
+  for (GPUBuffer &buffer : _clusterBuffers) {
+    buffer.cleanup(_device->allocator());
+  }
+  _clusterBuffers.clear();
+  _clusterAddresses.clear();
+
+  _deletionQueue.flush();
+}
+
+void LightCuller::buildPipeline(Slang::ComPtr<slang::ISession> session) {
+  VkPushConstantRange range = {};
+  range.offset = 0;
+  range.size = sizeof(GPULightCullPushConstants);
+  range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo layoutInfo = init::pipelineLayoutCreateInfo();
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &range;
+  VK_CHECK(vkCreatePipelineLayout(_device->device(), &layoutInfo, nullptr, &_pipelineLayout));
+
+  slang::IModule *module = utils::createSlangModule(session, "../resources/shaders/compute/light_cull.slang");
+  VkShaderModule shader;
+  if (!utils::loadShaderModule(session, module, _device->device(), "cullMain", &shader)) {
+    throw std::runtime_error("failed to create light cull shader module");
+  }
+
+  VkComputePipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.layout = _pipelineLayout;
+  pipelineInfo.stage = init::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shader);
+  VK_CHECK(vkCreateComputePipelines(_device->device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipeline));
+
+  vkDestroyShaderModule(_device->device(), shader, nullptr);
+
+  _deletionQueue.push_back([&]() {
+    vkDestroyPipeline(_device->device(), _pipeline, nullptr);
+    vkDestroyPipelineLayout(_device->device(), _pipelineLayout, nullptr);
+  });
+}
+
+void LightCuller::prepare(uint32_t frame, GPURingBuffer &ring, GPUSceneData &sceneData, VkExtent2D drawExtent,
+                          float nearDepth, float farDepth) {
+  _lightCount = activeLightCount();
+
+  sceneData.lights = 0;
+  if (_lightCount) {
+    GPURingBuffer::Allocation allocation = ring.allocate(_lightCount * sizeof(GPULight));
+    memcpy(allocation.data, _lights.data(), _lightCount * sizeof(GPULight));
+    sceneData.lights = ring.deviceAddress() + allocation.offset;
+  }
+
+  // slices grow with depth so clusters stay roughly cubic
+  const float depthScale = CLUSTERS_Z / std::log(farDepth / nearDepth);
+  sceneData.clusterLights = _clusterAddresses[frame];
+  sceneData.clusterCount = {CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, _lightCount};
+  sceneData.clusterScale = {static_cast<float>(CLUSTERS_X) / std::max(drawExtent.width, 1u),
+                            static_cast<float>(CLUSTERS_Y) / std::max(drawExtent.height, 1u), depthScale,
+                            std::log(nearDepth) * depthScale};
+}
+
+void LightCuller::cull(VkCommandBuffer cmd, uint32_t frame, VkDeviceAddress sceneData) {
+  // without lights the fragment shaders never read the clusters
+  if (!_lightCount) {
+    return;
+  }
+
+  GPULightCullPushConstants pushConstants = {};
+  pushConstants.sceneData = sceneData;
+
+  // the last reads of this frame's clusters finished before its fence signaled
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+  vkCmdPushConstants(cmd, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+  vkCmdDispatch(cmd, (CLUSTER_COUNT + 63) / 64, 1, 1);
+
+  utils::bufferBarrier(cmd, _clusterBuffers[frame].buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                       VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+}
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,43 @@
+#include "rendering/lod_selector.h"
+
+#include <algorithm>
+
+namespace bisky {
+namespace rendering {
+
+std::span<const uint8_t> LodSelector::select(const RenderContext &context, std::span<const uint32_t> visible,
+                                             const glm::vec3 &cameraPosition, float projectionScale) {
+  _levels.resize(visible.size());
+  _triangles = 0;
+  _fullTriangles = 0;
+
+  const float pixelsPerError = projectionScale / _threshold;
+  for (size_t i = 0; i < visible.size(); i++) {
+    const GPUObject &object = context.objects[visible[i]];
+    _fullTriangles += object.indexCount / 3;
+
+    uint8_t level = 0;
+    if (object.lods.size() > 1) {
+      // errors and radius are in object space, scale them by the largest axis of the transform
+      const glm::mat4 &m = object.transform;
+      const float scale = std::max({glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])),
+                                    glm::length(glm::vec3(m[2]))});
+      const glm::vec3 center = glm::vec3(m * glm::vec4(object.bounds.origin, 1.0f));
+      const float distance =
+          std::max(glm::distance(center, cameraPosition) - object.bounds.sphereRadius * scale, 1e-4f);
+
+      const float factor = scale * pixelsPerError / distance;
+      while (level + 1 < object.lods.size() && object.lods[level + 1].error * factor <= 1.0f) {
+        level++;
+      }
+    }
+
+    _levels[i] = level;
+    _triangles += (object.lods.empty() ? object.indexCount : object.lods[level].indexCount) / 3;
+  }
+
+  return _levels;
+}
+
+} // namespace rendering
+} // namespace bisky
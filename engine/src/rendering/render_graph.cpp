@@ -0,0 +1,428 @@
+#include "rendering/render_graph.h"
+#include "core/device.h"
+#include "utils/init.h"
+#include "utils/utils.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+namespace bisky {
+namespace rendering {
+
+namespace {
+
+bool isOutput(AttachmentUsage usage) {
+  return usage != AttachmentUsage::ATTACHMENT_INPUT && usage != AttachmentUsage::TRANSFER_INPUT;
+}
+
+core::ImageState accessState(AttachmentUsage usage, VkPipelineStageFlags2 passStages) {
+  switch (usage) {
+  case AttachmentUsage::COLOR_OUTPUT:
+    return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT};
+  case AttachmentUsage::DEPTH_OUTPUT:
+    return {VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+            VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT};
+  case AttachmentUsage::STORAGE_OUTPUT:
+    return {VK_IMAGE_LAYOUT_GENERAL, passStages, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT};
+  case AttachmentUsage::ATTACHMENT_INPUT:
+    return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, passStages, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT};
+  case AttachmentUsage::TRANSFER_INPUT:
+    return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT};
+  case AttachmentUsage::TRANSFER_OUTPUT:
+    return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT};
+  }
+
+  return {};
+}
+
+VkImageUsageFlags usageFlags(AttachmentUsage usage) {
+  switch (usage) {
+  case AttachmentUsage::COLOR_OUTPUT:
+    return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  case AttachmentUsage::DEPTH_OUTPUT:
+    return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  case AttachmentUsage::STORAGE_OUTPUT:
+    return VK_IMAGE_USAGE_STORAGE_BIT;
+  case AttachmentUsage::ATTACHMENT_INPUT:
+    return VK_IMAGE_USAGE_SAMPLED_BIT;
+  case AttachmentUsage::TRANSFER_INPUT:
+    return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  case AttachmentUsage::TRANSFER_OUTPUT:
+    return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  }
+
+  return 0;
+}
+
+} // namespace
+
+RenderGraph::RenderGraph(Pointer<core::Device> device) : _device(device) {}
+
+RenderGraph::~RenderGraph() {}
+
+RenderPass &RenderGraph::addPass(const char *name, VkPipelineStageFlags2 stages) {
+  _passes.push_back(std::make_shared<RenderPass>(name, stages));
+  return *_passes.back();
+}
+
+void RenderGraph::importImage(const std::string &name, VkImage image, VkImageView view, VkFormat format,
+                              core::ImageState initial, VkImageLayout finalLayout) {
+  Resource &resource = _resources[findOrAddResource(name)];
+  resource.imported = true;
+  resource.image = image;
+  resource.view = view;
+  resource.format = format;
+  resource.initial = initial;
+  resource.finalLayout = finalLayout;
+}
+
+void RenderGraph::setImage(const std::string &name, VkImage image, VkImageView view) {
+  Resource &resource = _resources[resourceIndex(name)];
+  resource.image = image;
+  resource.view = view;
+}
+
+void RenderGraph::compile(VkExtent2D extent) {
+  releaseTransients();
+
+  for (const Pointer<RenderPass> &pass : _passes) {
+    for (const AttachmentAccess &access : pass->accesses()) {
+      findOrAddResource(access.name);
+    }
+    for (const AttachmentInfo &attachment : pass->attachments()) {
+      Resource &resource = _resources[resourceIndex(attachment.name)];
+      if (!resource.imported && attachment.format != VK_FORMAT_UNDEFINED) {
+        resource.info = attachment;
+        resource.format = attachment.format;
+      }
+    }
+  }
+
+  for (Resource &resource : _resources) {
+    if (!resource.imported && resource.format == VK_FORMAT_UNDEFINED) {
+      throw std::runtime_error("render graph attachment " + resource.name + " is neither imported nor created");
+    }
+    resource.firstPass = -1;
+    resource.lastPass = -1;
+    resource.slot = -1;
+    resource.usage = 0;
+  }
+
+  sortPasses();
+  createTransients(extent);
+  computeBarriers();
+}
+
+void RenderGraph::resize(VkExtent2D extent, core::DeletionQueue &retired) {
+  // the pass order and barriers do not depend on the extent
+  releaseTransients(&retired);
+  createTransients(extent);
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd) {
+  for (uint32_t i = 0; i < _order.size(); i++) {
+    flushBarriers(cmd, _passBarriers[i]);
+
+    RenderPass &pass = *_passes[_order[i]];
+    if (_profiler) {
+      GpuProfiler::Scope zone(*_profiler, cmd, pass.name());
+      pass.execute(cmd, *this);
+    } else {
+      pass.execute(cmd, *this);
+    }
+  }
+
+  flushBarriers(cmd, _finalBarriers);
+}
+
+void RenderGraph::cleanup() { releaseTransients(); }
+
+uint32_t RenderGraph::resourceIndex(const std::string &name) {
+  auto it = _resourceIds.find(name);
+  if (it == _resourceIds.end()) {
+    throw std::runtime_error("render graph attachment " + name + " does not exist");
+  }
+
+  return it->second;
+}
+
+uint32_t RenderGraph::findOrAddResource(const std::string &name) {
+  auto [it, inserted] = _resourceIds.try_emplace(name, static_cast<uint32_t>(_resources.size()));
+  if (inserted) {
+    Resource resource = {};
+    resource.name = name;
+    _resources.push_back(resource);
+  }
+
+  return it->second;
+}
+
+void RenderGraph::sortPasses() {
+  const uint32_t passCount = static_cast<uint32_t>(_passes.size());
+
+  Vector<Vector<uint32_t>> dependents(passCount);
+  Vector<uint32_t> dependencies(passCount, 0);
+  auto addEdge = [&](uint32_t from, uint32_t to) {
+    if (from != to) {
+      dependents[from].push_back(to);
+      dependencies[to]++;
+    }
+  };
+
+  // reads depend on the last writer, writes also on every read since then
+  Vector<int32_t> lastWriter(_resources.size(), -1);
+  Vector<Vector<uint32_t>> readers(_resources.size());
+  for (uint32_t pass = 0; pass < passCount; pass++) {
+    for (const AttachmentAccess &access : _passes[pass]->accesses()) {
+      uint32_t resource = resourceIndex(access.name);
+      if (lastWriter[resource] >= 0) {
+        addEdge(lastWriter[resource], pass);
+      }
+
+      if (isOutput(access.usage)) {
+        for (uint32_t reader : readers[resource]) {
+          addEdge(reader, pass);
+        }
+        readers[resource].clear();
+        lastWriter[resource] = pass;
+      } else {
+        readers[resource].push_back(pass);
+      }
+    }
+  }
+
+  // ready passes are taken in declaration order so independent passes keep the order they were added in
+  std::priority_queue<uint32_t, Vector<uint32_t>, std::greater<uint32_t>> ready;
+  for (uint32_t pass = 0; pass < passCount; pass++) {
+    if (dependencies[pass] == 0) {
+      ready.push(pass);
+    }
+  }
+
+  _order.clear();
+  while (!ready.empty()) {
+    uint32_t pass = ready.top();
+    ready.pop();
+    _order.push_back(pass);
+
+    for (uint32_t dependent : dependents[pass]) {
+      if (--dependencies[dependent] == 0) {
+        ready.push(dependent);
+      }
+    }
+  }
+
+  if (_order.size() != passCount) {
+    throw std::runtime_error("render graph has a dependency cycle");
+  }
+}
+
+void RenderGraph::createTransients(VkExtent2D extent) {
+  for (uint32_t i = 0; i < _order.size(); i++) {
+    for (const AttachmentAccess &access : _passes[_order[i]]->accesses()) {
+      Resource &resource = _resources[resourceIndex(access.name)];
+      if (resource.firstPass < 0) {
+        resource.firstPass = static_cast<int32_t>(i);
+      }
+      resource.lastPass = static_cast<int32_t>(i);
+      resource.usage |= usageFlags(access.usage);
+    }
+  }
+
+  Vector<uint32_t> transients;
+  for (uint32_t i = 0; i < _resources.size(); i++) {
+    if (!_resources[i].imported && _resources[i].firstPass >= 0) {
+      transients.push_back(i);
+    }
+  }
+  std::sort(transients.begin(), transients.end(),
+            [&](uint32_t a, uint32_t b) { return _resources[a].firstPass < _resources[b].firstPass; });
+
+  for (uint32_t index : transients) {
+    Resource &resource = _resources[index];
+
+    VkExtent3D size = {std::max(1u, static_cast<uint32_t>(resource.info.size_x * extent.width)),
+                       std::max(1u, static_cast<uint32_t>(resource.info.size_y * extent.height)), 1};
+    VkImageCreateInfo imageInfo = init::imageCreateInfo(resource.format, resource.usage, size);
+    imageInfo.mipLevels = resource.info.levels;
+    imageInfo.arrayLayers = resource.info.layers;
+    imageInfo.samples = static_cast<VkSampleCountFlagBits>(resource.info.samples);
+    VK_CHECK(vkCreateImage(_device->device(), &imageInfo, nullptr, &resource.image));
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(_device->device(), resource.image, &requirements);
+
+    // share memory with the first slot whose last occupant is done before this attachment is first used
+    int32_t slotIndex = -1;
+    for (uint32_t i = 0; i < _slots.size(); i++) {
+      const Resource &occupant = _resources[_slots[i].resources.back()];
+      if (occupant.lastPass < resource.firstPass &&
+          (_slots[i].requirements.memoryTypeBits & requirements.memoryTypeBits) != 0) {
+        slotIndex = static_cast<int32_t>(i);
+        break;
+      }
+    }
+
+    if (slotIndex < 0) {
+      _slots.push_back(MemorySlot{requirements});
+      slotIndex = static_cast<int32_t>(_slots.size() - 1);
+    } else {
+      MemorySlot &slot = _slots[slotIndex];
+      slot.requirements.size = std::max(slot.requirements.size, requirements.size);
+      slot.requirements.alignment = std::max(slot.requirements.alignment, requirements.alignment);
+      slot.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+    }
+
+    _slots[slotIndex].resources.push_back(index);
+    resource.slot = slotIndex;
+  }
+
+  VmaAllocationCreateInfo allocInfo = {};
+  allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+  allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  _transientMemory = 0;
+  for (MemorySlot &slot : _slots) {
+    VK_CHECK(vmaAllocateMemory(_device->allocator(), &slot.requirements, &allocInfo, &slot.allocation, nullptr));
+    _transientMemory += slot.requirements.size;
+
+    for (uint32_t index : slot.resources) {
+      Resource &resource = _resources[index];
+      VK_CHECK(vmaBindImageMemory(_device->allocator(), slot.allocation, resource.image));
+
+      VkImageViewCreateInfo viewInfo =
+          init::imageViewCreateInfo(resource.format, resource.image, utils::aspectMask(resource.format));
+      viewInfo.viewType = resource.info.layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.subresourceRange.levelCount = resource.info.levels;
+      viewInfo.subresourceRange.layerCount = resource.info.layers;
+      VK_CHECK(vkCreateImageView(_device->device(), &viewInfo, nullptr, &resource.view));
+    }
+  }
+}
+
+void RenderGraph::computeBarriers() {
+  _passBarriers.assign(_order.size(), {});
+  _finalBarriers.clear();
+
+  Vector<core::ImageState> states(_resources.size());
+  Vector<int32_t> firstBarriers(_resources.size(), -1);
+  for (uint32_t i = 0; i < _resources.size(); i++) {
+    if (_resources[i].imported) {
+      states[i] = _resources[i].initial;
+    }
+  }
+
+  for (uint32_t i = 0; i < _order.size(); i++) {
+    const RenderPass &pass = *_passes[_order[i]];
+    for (const AttachmentAccess &access : pass.accesses()) {
+      uint32_t index = resourceIndex(access.name);
+      core::ImageState &state = states[index];
+      core::ImageState dst = accessState(access.usage, pass.stages());
+
+      bool firstUse = firstBarriers[index] < 0;
+      if (firstUse || core::ImageStateTracker::needsBarrier(state, dst)) {
+        if (firstUse) {
+          firstBarriers[index] = static_cast<int32_t>(_passBarriers[i].size());
+        }
+        _passBarriers[i].push_back({index, state, dst});
+        state = dst;
+      } else {
+        // reads in the same layout only widen what the next write has to wait for
+        state.stages |= dst.stages;
+        state.access |= dst.access;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < _resources.size(); i++) {
+    const Resource &resource = _resources[i];
+    if (resource.imported && resource.firstPass >= 0 && resource.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED &&
+        resource.finalLayout != states[i].layout) {
+      core::ImageState dst = {resource.finalLayout, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE};
+      _finalBarriers.push_back({i, states[i], dst});
+      states[i] = dst;
+    }
+  }
+
+  // the first use in a frame also waits for the last use of the same memory, which is the previous occupant of an
+  // aliased slot or the image itself in the previous frame
+  for (uint32_t i = 0; i < _resources.size(); i++) {
+    if (firstBarriers[i] < 0) {
+      continue;
+    }
+
+    const Resource &resource = _resources[i];
+    uint32_t previous = i;
+    if (!resource.imported) {
+      const Vector<uint32_t> &occupants = _slots[resource.slot].resources;
+      size_t position = std::find(occupants.begin(), occupants.end(), i) - occupants.begin();
+      previous = occupants[(position + occupants.size() - 1) % occupants.size()];
+    }
+
+    Barrier &barrier = _passBarriers[resource.firstPass][firstBarriers[i]];
+    barrier.src.stages |= states[previous].stages;
+    barrier.src.access |= states[previous].access;
+  }
+}
+
+void RenderGraph::flushBarriers(VkCommandBuffer cmd, const Vector<Barrier> &barriers) {
+  if (barriers.empty()) {
+    return;
+  }
+
+  _imageBarriers.clear();
+  for (const Barrier &barrier : barriers) {
+    const Resource &resource = _resources[barrier.resource];
+    _imageBarriers.push_back(core::ImageStateTracker::makeBarrier(resource.image, utils::aspectMask(resource.format),
+                                                                  barrier.src, barrier.dst));
+  }
+
+  VkDependencyInfo depInfo = {};
+  depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  depInfo.imageMemoryBarrierCount = static_cast<uint32_t>(_imageBarriers.size());
+  depInfo.pImageMemoryBarriers = _imageBarriers.data();
+
+  vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
+void RenderGraph::releaseTransients(core::DeletionQueue *retired) {
+  Vector<std::pair<VkImage, VkImageView>> images;
+  for (Resource &resource : _resources) {
+    if (resource.imported || resource.image == VK_NULL_HANDLE) {
+      continue;
+    }
+
+    images.emplace_back(resource.image, resource.view);
+    resource.view = VK_NULL_HANDLE;
+    resource.image = VK_NULL_HANDLE;
+  }
+
+  Vector<VmaAllocation> allocations;
+  for (MemorySlot &slot : _slots) {
+    allocations.push_back(slot.allocation);
+  }
+  _slots.clear();
+  _transientMemory = 0;
+
+  auto release = [device = _device, images = std::move(images), allocations = std::move(allocations)]() {
+    for (auto [image, view] : images) {
+      vkDestroyImageView(device->device(), view, nullptr);
+      vkDestroyImage(device->device(), image, nullptr);
+    }
+    for (VmaAllocation allocation : allocations) {
+      vmaFreeMemory(device->allocator(), allocation);
+    }
+  };
+
+  if (retired) {
+    retired->push_back(std::move(release));
+  } else {
+    release();
+  }
+}
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,48 @@
+#include "rendering/render_pass.h"
+
+namespace bisky {
+namespace rendering {
+
+RenderPass::RenderPass(std::string name, VkPipelineStageFlags2 stages) : _name(std::move(name)), _stages(stages) {}
+
+RenderPass::~RenderPass() {}
+
+void RenderPass::addColorOutput(std::string name, AttachmentInfo attachment) {
+  addOutput(std::move(name), AttachmentUsage::COLOR_OUTPUT, std::move(attachment));
+}
+
+void RenderPass::addDepthOutput(std::string name, AttachmentInfo attachment) {
+  addOutput(std::move(name), AttachmentUsage::DEPTH_OUTPUT, std::move(attachment));
+}
+
+void RenderPass::addStorageOutput(std::string name, AttachmentInfo attachment) {
+  addOutput(std::move(name), AttachmentUsage::STORAGE_OUTPUT, std::move(attachment));
+}
+
+void RenderPass::addTransferOutput(std::string name, AttachmentInfo attachment) {
+  addOutput(std::move(name), AttachmentUsage::TRANSFER_OUTPUT, std::move(attachment));
+}
+
+void RenderPass::addAttachmentInput(std::string name) { addInput(std::move(name), AttachmentUsage::ATTACHMENT_INPUT); }
+
+void RenderPass::addTransferInput(std::string name) { addInput(std::move(name), AttachmentUsage::TRANSFER_INPUT); }
+
+void RenderPass::execute(VkCommandBuffer cmd, RenderGraph &graph) {
+  if (_execute) {
+    _execute(cmd, graph);
+  }
+}
+
+void RenderPass::addOutput(std::string name, AttachmentUsage usage, AttachmentInfo attachment) {
+  attachment.name = name;
+  _outputs.push_back(attachment);
+  _accesses.push_back({std::move(name), usage});
+}
+
+void RenderPass::addInput(std::string name, AttachmentUsage usage) {
+  _inputs.push_back(name);
+  _accesses.push_back({std::move(name), usage});
+}
+
+} // namespace rendering
+} // namespace bisky
@@ -0,0 +1,29 @@
+#include "rendering/renderable.h"
+
+namespace bisky {
+namespace rendering {
+
+MeshNode::MeshNode(Pointer<MeshAsset> mesh, Pointer<MaterialInstance> material, glm::mat4 transform)
+    : mesh(mesh), material(material), transform(transform) {}
+
+void MeshNode::draw(const glm::mat4 &topMatrix, RenderContext &ctx) {
+  glm::mat4 nodeMatrix = topMatrix * transform;
+
+  for (const GeoSurface &surface : mesh->surfaces) {
+    GPUObject object = {};
+    object.indexCount = surface.count;
+    object.firstIndex = surface.startIndex;
+    object.lods = surface.lods;
+    object.material = material;
+    object.indexBuffer = mesh->meshBuffers.indexBuffer.buffer;
+    object.indexType = mesh->meshBuffers.indexType;
+    object.vertexBufferAddress = mesh->meshBuffers.vertexBufferAddress;
+    object.transform = nodeMatrix;
+    object.bounds = surface.bounds;
+
+    ctx.objects.push_back(object);
+  }
+}
+
+} // namespace rendering
+} // namespace bisky
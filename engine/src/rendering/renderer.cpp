@@ -1,4 +1,5 @@
 #include "core/compute_pipeline.h"
+#include "core/cpu_profiler.h"
 #include "core/descriptor_allocator_growable.h"
 #include "core/descriptor_writer.h"
 #include "core/descriptors.h"
@@ -11,6 +12,7 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_vulkan.h"
 #include "pch.h"
+#include "stb_image_write.h"
 #include "utils/init.h"
 #include "utils/utils.h"
 
@@ -23,23 +25,51 @@
 namespace bisky {
 namespace rendering {
 
-Renderer::Renderer(Pointer<core::Window> window, Pointer<core::Device> device, VkSwapchainKHR oldSwapchain)
-    : _window(window), _device(device), _oldSwapchain(oldSwapchain) {
+Renderer::Renderer(Pointer<core::Window> window, Pointer<core::Device> device, RendererSettings settings,
+                   VkSwapchainKHR oldSwapchain)
+    : _window(window), _device(device), _settings(settings), _oldSwapchain(oldSwapchain) {
+  initialize();
+}
+
+Renderer::Renderer(Pointer<core::Device> device, VkExtent2D extent, RendererSettings settings)
+    : _device(device), _settings(settings), _oldSwapchain(VK_NULL_HANDLE), _extent(extent) {
   initialize();
 }
 
 Renderer::~Renderer() {}
 
 void Renderer::initialize() {
+  _frames.resize(std::clamp(_settings.framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT));
+  _framePacer = FramePacer(framesInFlight());
+  _framePacer.setQueuedFrames(_settings.queuedFrames ? _settings.queuedFrames : framesInFlight());
+  _presentMode = _settings.presentMode;
+  _resolutionScaler = ResolutionScaler(_settings.resolution, framesInFlight());
+
   _immediateSubmit = std::make_shared<core::ImmediateSubmit>(_device);
+  _descriptorCache = std::make_shared<core::DescriptorCache>();
+  _gpuProfiler = std::make_shared<GpuProfiler>(_device, framesInFlight());
 
-  createSwapchain();
-  createImageViews();
+  // leave a core for the main thread, which records the primary command buffer
+  uint32_t threadCount = std::thread::hardware_concurrency();
+  _workers = std::make_shared<core::ThreadPool>(threadCount > 1 ? threadCount - 1 : 1);
+
+  if (headless()) {
+    createOffscreenImages();
+  } else {
+    createSwapchain();
+    createImageViews();
+  }
+  createDrawImages();
   initializeCommands();
   initializeSyncStructures();
   initializeDescriptors();
+  initializeFrameUniforms();
+  initializeRenderGraph();
   initializeDefaultData();
-  initializeImgui();
+
+  if (!headless()) {
+    initializeImgui();
+  }
 }
 
 void Renderer::initializeDefaultData() {
@@ -71,6 +101,9 @@ void Renderer::initializeDefaultData() {
   sample.magFilter = VK_FILTER_LINEAR;
   sample.minFilter = VK_FILTER_LINEAR;
   VK_CHECK(vkCreateSampler(_device->device(), &sample, nullptr, &_defaultSamplerLinear));
+
+  _nearestSamplerIndex = _bindless.addSampler(_device->device(), _defaultSamplerNearest);
+  _linearSamplerIndex = _bindless.addSampler(_device->device(), _defaultSamplerLinear);
 }
 
 void Renderer::initializeImgui() {
@@ -123,23 +156,44 @@ void Renderer::initializeImgui() {
 void Renderer::cleanup() {
   vkDestroySampler(_device->device(), _defaultSamplerLinear, nullptr);
   vkDestroySampler(_device->device(), _defaultSamplerNearest, nullptr);
-  _whiteImage.cleanup(_device->device(), _device->allocator());
-  _blackImage.cleanup(_device->device(), _device->allocator());
-  _greyImage.cleanup(_device->device(), _device->allocator());
-  _errorCheckerboardImage.cleanup(_device->device(), _device->allocator());
+  destroyImage(_whiteImage);
+  destroyImage(_blackImage);
+  destroyImage(_greyImage);
+  destroyImage(_errorCheckerboardImage);
 
   for (auto &frame : _frames) {
     vkDestroySemaphore(_device->device(), frame.renderSemaphore, nullptr);
     vkDestroySemaphore(_device->device(), frame.swapchainSemaphore, nullptr);
     vkDestroyFence(_device->device(), frame.renderFence, nullptr);
     vkDestroyCommandPool(_device->device(), frame.commandPool, nullptr);
+    for (WorkerCommands &worker : frame.workers) {
+      vkDestroyCommandPool(_device->device(), worker.commandPool, nullptr);
+    }
+    if (_device->hasAsyncCompute()) {
+      vkDestroySemaphore(_device->device(), frame.computeSemaphore, nullptr);
+      vkDestroyCommandPool(_device->device(), frame.computeCommandPool, nullptr);
+    }
+    frame.uniformRing.cleanup(_device->allocator());
     frame.deletionQueue.flush();
   }
 
+  if (!headless()) {
+    _retiredSwapchains.flush();
+    for (VkImageView imageView : _imageViews) {
+      vkDestroyImageView(_device->device(), imageView, nullptr);
+    }
+    vkDestroySwapchainKHR(_device->device(), _swapchain, nullptr);
+  }
+
+  _frameUniformAllocator.destroyPool(_device->device());
+  _renderGraph->cleanup();
+  _gpuProfiler->cleanup();
   _immediateSubmit->cleanup();
 
-  ImGui_ImplVulkan_Shutdown();
-  vkDestroyDescriptorPool(_device->device(), _imguiPool, nullptr);
+  if (!headless()) {
+    ImGui_ImplVulkan_Shutdown();
+    vkDestroyDescriptorPool(_device->device(), _imguiPool, nullptr);
+  }
 
   _deletionQueue.flush();
 }
@@ -157,11 +211,12 @@ VkSurfaceFormatKHR Renderer::chooseSwapSurfaceFormat(const std::vector<VkSurface
 
 VkPresentModeKHR Renderer::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes) {
   for (const auto &availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+    if (availablePresentMode == _settings.presentMode) {
       return availablePresentMode;
     }
   }
 
+  // the only mode every surface supports
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -189,7 +244,8 @@ void Renderer::createSwapchain() {
   VkPresentModeKHR presentMode = chooseSwapPresentMode(details.presentModes);
   VkExtent2D extent = chooseSwapExtent(details.capabilities);
 
-  uint32_t imageCount = details.capabilities.minImageCount + 1;
+  // enough images that every frame in flight can hold one while another is presented
+  uint32_t imageCount = std::max(details.capabilities.minImageCount + 1, framesInFlight() + 1);
   if (details.capabilities.maxImageCount > 0 && imageCount > details.capabilities.maxImageCount) {
     imageCount = details.capabilities.maxImageCount;
   }
@@ -217,13 +273,52 @@ void Renderer::createSwapchain() {
 
   _format = format.format;
   _extent = extent;
+  _presentMode = presentMode;
+}
 
-  _deletionQueue.push_back([&]() { vkDestroySwapchainKHR(_device->device(), _swapchain, nullptr); });
+void Renderer::createOffscreenImages() {
+  // srgb like the swapchain, so the blit from the draw image encodes the same way and the pixels can be saved as is
+  _format = VK_FORMAT_R8G8B8A8_SRGB;
 
-  VkExtent3D drawImageExtent = {_extent.width, _extent.height, 1};
+  const size_t frameSize = _extent.width * _extent.height * 4;
+  GPUBuffer::Builder builder;
+
+  for (uint32_t i = 0; i < _frames.size(); i++) {
+    _offscreenImages.push_back(createImage(VkExtent3D{_extent.width, _extent.height, 1}, _format,
+                                           VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                               VK_IMAGE_USAGE_TRANSFER_SRC_BIT));
+    _images.push_back(_offscreenImages.back().image);
+    _imageViews.push_back(_offscreenImages.back().imageView);
+
+    _readbackBuffers.push_back(builder.build(_device->allocator(), frameSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                             VMA_MEMORY_USAGE_GPU_TO_CPU));
+  }
+
+  _deletionQueue.push_back([&]() {
+    for (uint32_t i = 0; i < _offscreenImages.size(); i++) {
+      vkDestroyImageView(_device->device(), _offscreenImages[i].imageView, nullptr);
+      vmaDestroyImage(_device->allocator(), _offscreenImages[i].image, _offscreenImages[i].allocation);
+      _readbackBuffers[i].cleanup(_device->allocator());
+    }
+    _offscreenImages.clear();
+    _readbackBuffers.clear();
+  });
+}
 
-  _drawImage.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-  _drawImage.extent = drawImageExtent;
+void Renderer::createDrawImages() {
+  // one draw image per frame, so the background of the next frame can be computed while this one rasterizes
+  for (uint32_t i = 0; i < _frames.size(); i++) {
+    createDrawImage(_frames[i].drawImage);
+
+    _deletionQueue.push_back([&, i]() {
+      vkDestroyImageView(_device->device(), _frames[i].drawImage.imageView, nullptr);
+      vmaDestroyImage(_device->allocator(), _frames[i].drawImage.image, _frames[i].drawImage.allocation);
+    });
+  }
+}
+
+void Renderer::createDrawImage(AllocatedImage &drawImage) {
+  VkExtent3D drawImageExtent = {_extent.width, _extent.height, 1};
 
   VkImageUsageFlags drawImageUsages = {};
   drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
@@ -231,38 +326,40 @@ void Renderer::createSwapchain() {
   drawImageUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
   drawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-  VkImageCreateInfo imgInfo = init::imageCreateInfo(_drawImage.format, drawImageUsages, drawImageExtent);
   VmaAllocationCreateInfo allocInfo = {};
   allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
   allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  VK_CHECK(
-      vmaCreateImage(_device->allocator(), &imgInfo, &allocInfo, &_drawImage.image, &_drawImage.allocation, nullptr));
 
-  VkImageViewCreateInfo viewInfo =
-      init::imageViewCreateInfo(_drawImage.format, _drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
-  VK_CHECK(vkCreateImageView(_device->device(), &viewInfo, nullptr, &_drawImage.imageView));
+  uint32_t drawImageFamilies[] = {_device->queueFamily(), _device->computeQueueFamily()};
+  drawImage.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+  drawImage.extent = drawImageExtent;
 
-  _deletionQueue.push_back([&]() {
-    vkDestroyImageView(_device->device(), _drawImage.imageView, nullptr);
-    vmaDestroyImage(_device->allocator(), _drawImage.image, _drawImage.allocation);
-  });
+  VkImageCreateInfo imgInfo = init::imageCreateInfo(drawImage.format, drawImageUsages, drawImageExtent);
+  // written by the compute queue and read by graphics, concurrent sharing avoids ownership transfers
+  if (drawImageFamilies[0] != drawImageFamilies[1]) {
+    imgInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    imgInfo.queueFamilyIndexCount = 2;
+    imgInfo.pQueueFamilyIndices = drawImageFamilies;
+  }
+  VK_CHECK(
+      vmaCreateImage(_device->allocator(), &imgInfo, &allocInfo, &drawImage.image, &drawImage.allocation, nullptr));
 
-  _depthImage.format = VK_FORMAT_D32_SFLOAT;
-  _depthImage.extent = _drawImage.extent;
-  VkImageUsageFlags depthImageUsages = {};
-  depthImageUsages |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  VkImageViewCreateInfo viewInfo =
+      init::imageViewCreateInfo(drawImage.format, drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+  VK_CHECK(vkCreateImageView(_device->device(), &viewInfo, nullptr, &drawImage.imageView));
+}
 
-  VkImageCreateInfo depthImageInfo = init::imageCreateInfo(_depthImage.format, depthImageUsages, _depthImage.extent);
-  vmaCreateImage(_device->allocator(), &depthImageInfo, &allocInfo, &_depthImage.image, &_depthImage.allocation,
-                 nullptr);
-  VkImageViewCreateInfo depthViewInfo =
-      init::imageViewCreateInfo(_depthImage.format, _depthImage.image, VK_IMAGE_ASPECT_DEPTH_BIT);
-  VK_CHECK(vkCreateImageView(_device->device(), &depthViewInfo, nullptr, &_depthImage.imageView));
+void Renderer::resizeDrawImage(FrameData &frame) {
+  // only called once the frame's fence has signaled, which covers the compute work the graphics submit waited on
+  vkDestroyImageView(_device->device(), frame.drawImage.imageView, nullptr);
+  vmaDestroyImage(_device->allocator(), frame.drawImage.image, frame.drawImage.allocation);
+  createDrawImage(frame.drawImage);
 
-  _deletionQueue.push_back([&]() {
-    vkDestroyImageView(_device->device(), _depthImage.imageView, nullptr);
-    vmaDestroyImage(_device->allocator(), _depthImage.image, _depthImage.allocation);
-  });
+  // the set is no longer in use either, so it is rewritten in place instead of allocating a new one
+  core::DescriptorWriter writer;
+  writer.writeImage(0, frame.drawImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL,
+                    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+  writer.updateSet(_device->device(), frame.drawImageDescriptors);
 }
 
 void Renderer::createImageViews() {
@@ -270,20 +367,36 @@ void Renderer::createImageViews() {
   for (size_t i = 0; i < _images.size(); i++) {
     _imageViews[i] = _device->createImageView(_images[i], _format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
   }
-
-  for (auto &imageView : _imageViews) {
-    _deletionQueue.push_back([&]() { vkDestroyImageView(_device->device(), imageView, nullptr); });
-  }
 }
 
 void Renderer::initializeCommands() {
   VkCommandPoolCreateInfo commandPoolInfo =
       init::commandPoolCreateInfo(_device->queueFamily(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-  for (uint32_t i = 0; i < FRAME_OVERLAP; i++) {
+  for (uint32_t i = 0; i < _frames.size(); i++) {
     VK_CHECK(vkCreateCommandPool(_device->device(), &commandPoolInfo, nullptr, &_frames[i].commandPool));
     VkCommandBufferAllocateInfo allocInfo = init::commandBufferAllocateInfo(_frames[i].commandPool);
     VK_CHECK(vkAllocateCommandBuffers(_device->device(), &allocInfo, &_frames[i].mainCommandBuffer));
+
+    if (_device->hasAsyncCompute()) {
+      VkCommandPoolCreateInfo computePoolInfo = init::commandPoolCreateInfo(
+          _device->computeQueueFamily(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+      VK_CHECK(vkCreateCommandPool(_device->device(), &computePoolInfo, nullptr, &_frames[i].computeCommandPool));
+
+      VkCommandBufferAllocateInfo computeAllocInfo = init::commandBufferAllocateInfo(_frames[i].computeCommandPool);
+      VK_CHECK(vkAllocateCommandBuffers(_device->device(), &computeAllocInfo, &_frames[i].computeCommandBuffer));
+    }
+
+    // command pools are externally synchronized, so every worker records from its own
+    _frames[i].workers.resize(_workers->size());
+    for (WorkerCommands &worker : _frames[i].workers) {
+      VkCommandPoolCreateInfo workerPoolInfo = init::commandPoolCreateInfo(_device->queueFamily());
+      VK_CHECK(vkCreateCommandPool(_device->device(), &workerPoolInfo, nullptr, &worker.commandPool));
+
+      VkCommandBufferAllocateInfo workerAllocInfo = init::commandBufferAllocateInfo(worker.commandPool);
+      workerAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+      VK_CHECK(vkAllocateCommandBuffers(_device->device(), &workerAllocInfo, &worker.commandBuffer));
+    }
   }
 }
 
@@ -302,15 +415,14 @@ AllocatedImage Renderer::createImage(VkExtent3D size, VkFormat format, VkImageUs
   allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
   VK_CHECK(vmaCreateImage(_device->allocator(), &imgInfo, &allocInfo, &image.image, &image.allocation, nullptr));
 
-  VkImageAspectFlags aspectFlag = VK_IMAGE_ASPECT_COLOR_BIT;
-  if (format == VK_FORMAT_D32_SFLOAT) {
-    aspectFlag = VK_IMAGE_ASPECT_DEPTH_BIT;
-  }
-
-  VkImageViewCreateInfo viewInfo = init::imageViewCreateInfo(format, image.image, aspectFlag);
+  VkImageViewCreateInfo viewInfo = init::imageViewCreateInfo(format, image.image, utils::aspectMask(format));
   viewInfo.subresourceRange.levelCount = imgInfo.mipLevels;
   VK_CHECK(vkCreateImageView(_device->device(), &viewInfo, nullptr, &image.imageView));
 
+  if (usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+    image.textureIndex = _bindless.addTexture(_device->device(), image.imageView);
+  }
+
   return image;
 }
 
@@ -327,39 +439,61 @@ AllocatedImage Renderer::createImage(void *data, VkExtent3D size, VkFormat forma
   AllocatedImage image =
       createImage(size, format, usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, mipmapped);
 
-  _immediateSubmit->submit([&](VkCommandBuffer cmd) {
-    utils::transitionImage(cmd, image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-    VkBufferImageCopy copyRegion = {};
-    copyRegion.bufferOffset = 0;
-    copyRegion.bufferRowLength = 0;
-    copyRegion.bufferImageHeight = 0;
-
-    copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    copyRegion.imageSubresource.mipLevel = 0;
-    copyRegion.imageSubresource.baseArrayLayer = 0;
-    copyRegion.imageSubresource.layerCount = 1;
-    copyRegion.imageExtent = size;
-
-    vkCmdCopyBufferToImage(cmd, uploadBuffer.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-    utils::transitionImage(cmd, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-  });
-
-  uploadBuffer.cleanup(_device->allocator());
+  // the upload leaves the image owned by the graphics queue family, ready to be sampled
+  const core::ImmediateSubmit::ImageUpload upload = {
+      image.image,
+      utils::aspectMask(format),
+      {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+       VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+       VK_ACCESS_2_SHADER_SAMPLED_READ_BIT},
+  };
+
+  _immediateSubmit->upload(
+      [&](VkCommandBuffer cmd) {
+        VkBufferImageCopy copyRegion = {};
+        copyRegion.bufferOffset = 0;
+        copyRegion.bufferRowLength = 0;
+        copyRegion.bufferImageHeight = 0;
+
+        copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copyRegion.imageSubresource.mipLevel = 0;
+        copyRegion.imageSubresource.baseArrayLayer = 0;
+        copyRegion.imageSubresource.layerCount = 1;
+        copyRegion.imageExtent = size;
+
+        vkCmdCopyBufferToImage(cmd, uploadBuffer.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                               &copyRegion);
+      },
+      {}, {&upload, 1},
+      [allocator = _device->allocator(), uploadBuffer]() mutable { uploadBuffer.cleanup(allocator); });
+
+  _imageStates.track(image.image, upload.aspect, upload.state);
 
   return image;
 }
 
+void Renderer::destroyImage(const AllocatedImage &image) {
+  if (image.textureIndex != UINT32_MAX) {
+    _bindless.removeTexture(image.textureIndex, getCurrentFrame().deletionQueue);
+  }
+  _imageStates.untrack(image.image);
+  _descriptorCache->evict((uint64_t)image.imageView);
+  vkDestroyImageView(_device->device(), image.imageView, nullptr);
+  vmaDestroyImage(_device->allocator(), image.image, image.allocation);
+}
+
 void Renderer::initializeSyncStructures() {
   VkFenceCreateInfo fenceInfo = init::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
   VkSemaphoreCreateInfo semaphoreInfo = init::semaphoreCreateInfo();
 
-  for (uint32_t i = 0; i < FRAME_OVERLAP; i++) {
+  for (uint32_t i = 0; i < _frames.size(); i++) {
     VK_CHECK(vkCreateSemaphore(_device->device(), &semaphoreInfo, nullptr, &_frames[i].renderSemaphore));
     VK_CHECK(vkCreateSemaphore(_device->device(), &semaphoreInfo, nullptr, &_frames[i].swapchainSemaphore));
     VK_CHECK(vkCreateFence(_device->device(), &fenceInfo, nullptr, &_frames[i].renderFence));
+
+    if (_device->hasAsyncCompute()) {
+      VK_CHECK(vkCreateSemaphore(_device->device(), &semaphoreInfo, nullptr, &_frames[i].computeSemaphore));
+    }
   }
 }
 
@@ -370,30 +504,38 @@ void Renderer::initializeDescriptors() {
     core::DescriptorLayoutBuilder builder;
     _drawImageDescriptorLayout =
         builder.add(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE).build(_device->device(), VK_SHADER_STAGE_COMPUTE_BIT);
-    _drawImageDescriptors = _globalDescriptorAllocator.allocate(_device->device(), _drawImageDescriptorLayout);
   }
   {
     core::DescriptorLayoutBuilder builder;
     _gpuSceneDescriptorLayout =
-        builder.add(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+        builder.add(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC)
             .build(_device->device(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
   }
-  {
-    core::DescriptorLayoutBuilder builder;
-    _singleImageDescriptorLayout = builder.add(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
-                                       .build(_device->device(), VK_SHADER_STAGE_FRAGMENT_BIT);
-  }
+  _bindless.init(_device->device());
 
-  core::DescriptorWriter writer;
-  writer.writeImage(0, _drawImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-  writer.updateSet(_device->device(), _drawImageDescriptors);
+  Vector<core::DescriptorAllocatorGrowable::PoolSizeRatio> cacheSizes = {
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4},
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+      {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1},
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+  };
+  _descriptorCache->init(_device, framesInFlight(), 64, cacheSizes);
+
+  for (uint32_t i = 0; i < _frames.size(); i++) {
+    _frames[i].drawImageDescriptors =
+        _globalDescriptorAllocator.allocate(_device->device(), _drawImageDescriptorLayout);
+
+    core::DescriptorWriter writer;
+    writer.writeImage(0, _frames[i].drawImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL,
+                      VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    writer.updateSet(_device->device(), _frames[i].drawImageDescriptors);
 
-  for (int i = 0; i < FRAME_OVERLAP; i++) {
     Vector<core::DescriptorAllocatorGrowable::PoolSizeRatio> frameSizes = {
         {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3},
         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3},
         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3},
         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4},
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2},
     };
 
     _frames[i].frameDescriptors = core::DescriptorAllocatorGrowable{};
@@ -405,11 +547,130 @@ void Renderer::initializeDescriptors() {
   _deletionQueue.push_back([&]() {
     _globalDescriptorAllocator.destroyPool(_device->device());
     vkDestroyDescriptorSetLayout(_device->device(), _drawImageDescriptorLayout, nullptr);
-    vkDestroyDescriptorSetLayout(_device->device(), _singleImageDescriptorLayout, nullptr);
+    _bindless.cleanup(_device->device());
+    _descriptorCache->cleanup();
     vkDestroyDescriptorSetLayout(_device->device(), _gpuSceneDescriptorLayout, nullptr);
   });
 }
 
+void Renderer::initializeFrameUniforms() {
+  Vector<core::DescriptorAllocator::PoolSizeRatio> sizes = {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1}};
+  _frameUniformAllocator.initPool(_device->device(), framesInFlight(), sizes);
+
+  const size_t alignment = _device->properties().limits.minUniformBufferOffsetAlignment;
+
+  for (uint32_t i = 0; i < _frames.size(); i++) {
+    // instance data is read through buffer device address
+    _frames[i].uniformRing.init(_device->device(), _device->allocator(), 4 * 1024 * 1024, alignment,
+                                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+
+    // written once, the scene data is selected with a dynamic offset every frame
+    _frames[i].sceneDescriptors = _frameUniformAllocator.allocate(_device->device(), _gpuSceneDescriptorLayout);
+
+    core::DescriptorWriter writer;
+    writer.writeBuffer(0, _frames[i].uniformRing.buffer(), sizeof(GPUSceneData), 0,
+                       VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+    writer.updateSet(_device->device(), _frames[i].sceneDescriptors);
+  }
+}
+
+void Renderer::initializeRenderGraph() {
+  _renderGraph = std::make_shared<RenderGraph>(_device);
+  _renderGraph->setProfiler(_gpuProfiler);
+
+  // the acquire and compute semaphores are waited on at color output, so the first barriers have to start there
+  const AllocatedImage &drawImage = _frames[0].drawImage;
+  if (headless()) {
+    _renderGraph->importImage("output", VK_NULL_HANDLE, VK_NULL_HANDLE, _format, {});
+  } else {
+    _renderGraph->importImage("output", VK_NULL_HANDLE, VK_NULL_HANDLE, _format,
+                              {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT},
+                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+  }
+
+  if (_device->hasAsyncCompute()) {
+    _renderGraph->importImage("draw", drawImage.image, drawImage.imageView, drawImage.format,
+                              {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT});
+  } else {
+    _renderGraph->importImage("draw", drawImage.image, drawImage.imageView, drawImage.format, {});
+
+    RenderPass &background = _renderGraph->addPass("background", VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+    background.addStorageOutput("draw");
+    background.setExecute([this](VkCommandBuffer cmd, RenderGraph &) { drawBackground(cmd, *_backgroundEffect); });
+  }
+
+  // bin the lights into clusters for both draw paths, synchronized on its own buffers
+  RenderPass &lights = _renderGraph->addPass("lights", VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  lights.setExecute([this](VkCommandBuffer cmd, RenderGraph &) {
+    if (_lightCuller) {
+      _lightCuller->cull(cmd, _currentFrame, sceneDataAddress());
+    }
+  });
+
+  // cull the draw records and build the indirect commands for this frame, synchronized on its own buffers
+  RenderPass &cull = _renderGraph->addPass("cull", VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  cull.setExecute([this](VkCommandBuffer cmd, RenderGraph &) {
+    if (_gpuDriven && _indirectDrawer) {
+      // the early phase only reads the visibility buffer, but the cull set binds the pyramid in GENERAL for both
+      // phases, so a new pyramid has to be moved into that layout before its first build
+      _depthPyramid->initializeLayout(cmd);
+      _indirectDrawer->cull(cmd, _currentFrame, _sceneData.viewproj, _cameraPosition,
+                            _projectionScale / _lodSelector.threshold(), *_depthPyramid);
+    }
+  });
+
+  RenderPass &geometry = _renderGraph->addPass("geometry", VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT);
+  geometry.addColorOutput("draw");
+  geometry.addDepthOutput("depth", AttachmentInfo{.format = _depthFormat});
+  geometry.setExecute([this](VkCommandBuffer cmd, RenderGraph &) { drawGeometry(cmd, *_renderContext); });
+
+  // reduce the early depth into the pyramid and retest what the early phase rejected against it
+  RenderPass &occlusion = _renderGraph->addPass("occlusion", VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+  occlusion.addAttachmentInput("depth");
+  occlusion.setExecute([this](VkCommandBuffer cmd, RenderGraph &graph) {
+    if (_gpuDriven && _indirectDrawer && _indirectDrawer->occlusionActive(_currentFrame)) {
+      _depthPyramid->build(cmd, graph.imageView("depth"), _drawExtent);
+      _indirectDrawer->cullLate(cmd, _currentFrame, *_depthPyramid);
+    }
+  });
+
+  RenderPass &lateGeometry = _renderGraph->addPass("late geometry", VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT);
+  lateGeometry.addColorOutput("draw");
+  lateGeometry.addDepthOutput("depth");
+  lateGeometry.setExecute([this](VkCommandBuffer cmd, RenderGraph &) { drawLateGeometry(cmd); });
+
+  RenderPass &copy = _renderGraph->addPass("copy", VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT);
+  copy.addTransferInput("draw");
+  copy.addTransferOutput("output");
+  copy.setExecute([this](VkCommandBuffer cmd, RenderGraph &graph) {
+    utils::copyImageToImage(cmd, graph.image("draw"), graph.image("output"), _drawExtent, _extent);
+  });
+
+  if (headless()) {
+    RenderPass &readback = _renderGraph->addPass("readback", VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT);
+    readback.addTransferInput("output");
+    readback.setExecute([this](VkCommandBuffer cmd, RenderGraph &graph) {
+      VkBufferImageCopy region = {};
+      region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.imageSubresource.layerCount = 1;
+      region.imageExtent = {_extent.width, _extent.height, 1};
+
+      VkBuffer buffer = _readbackBuffers[_currentFrame].buffer;
+      vkCmdCopyImageToBuffer(cmd, graph.image("output"), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+      // the fence alone does not make the copy visible to the host
+      utils::bufferBarrier(cmd, buffer, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                           VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+    });
+  } else {
+    RenderPass &imgui = _renderGraph->addPass("imgui", VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT);
+    imgui.addColorOutput("output");
+    imgui.setExecute([this](VkCommandBuffer cmd, RenderGraph &graph) { drawImgui(cmd, graph.imageView("output")); });
+  }
+
+  _renderGraph->compile(_extent);
+}
+
 VkCommandBuffer Renderer::beginRenderPass() {
   VkCommandBuffer commandBuffer = currentCommandBuffer();
   VK_CHECK(vkResetCommandBuffer(commandBuffer, 0));
@@ -423,88 +684,171 @@ VkCommandBuffer Renderer::beginRenderPass() {
 void Renderer::endRenderPass(VkCommandBuffer commandBuffer) {
   VK_CHECK(vkEndCommandBuffer(commandBuffer));
 
-  VkCommandBufferSubmitInfo cmdInfo = init::commandBufferSubmitInfo(commandBuffer);
   VkSemaphoreSubmitInfo signalInfo =
       init::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, getCurrentFrame().renderSemaphore);
-  VkSemaphoreSubmitInfo waitInfo =
-      init::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, getCurrentFrame().swapchainSemaphore);
 
-  VkSubmitInfo2 submitInfo = init::submitInfo(&cmdInfo, &signalInfo, &waitInfo);
+  VkSemaphoreSubmitInfo waitInfos[3];
+  uint32_t waitCount = 0;
+
+  // uploads since the last submit are acquired ahead of the frame's commands, once their copies have finished
+  VkCommandBufferSubmitInfo cmdInfos[2];
+  uint32_t cmdCount = 0;
+  if (_immediateSubmit->acquire(getCurrentFrame().deletionQueue, cmdInfos[cmdCount], waitInfos[waitCount])) {
+    cmdCount++;
+    waitCount++;
+  }
+  cmdInfos[cmdCount++] = init::commandBufferSubmitInfo(commandBuffer);
+
+  // the background from the compute queue is first touched by the geometry's color attachment writes
+  if (!headless()) {
+    waitInfos[waitCount++] = init::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                                       getCurrentFrame().swapchainSemaphore);
+  }
+  if (getCurrentFrame().computeSubmitted) {
+    waitInfos[waitCount++] = init::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                                       getCurrentFrame().computeSemaphore);
+  }
+
+  // nothing is presented without a window, so nothing would wait on the render semaphore
+  VkSubmitInfo2 submitInfo = init::submitInfo(cmdInfos, headless() ? nullptr : &signalInfo, waitInfos);
+  submitInfo.commandBufferInfoCount = cmdCount;
+  submitInfo.waitSemaphoreInfoCount = waitCount;
+  getCurrentFrame().computeSubmitted = false;
 
   VK_CHECK(vkQueueSubmit2(_device->queue(), 1, &submitInfo, getCurrentFrame().renderFence));
+  _framePacer.submitted(_currentFrame);
+  _lastSubmittedFrame = _currentFrame;
 }
 
-void Renderer::clear(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-  // transition our swapchain image to a general layout
-  utils::transitionImage(commandBuffer, _images[imageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-
-  // clear the swapchain image
-  VkClearColorValue clearValue = {};
-  clearValue = {{0.0f, 1.0f, 0.0f, 1.0f}};
-  VkImageSubresourceRange clearRange = init::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
-  vkCmdClearColorImage(commandBuffer, _images[imageIndex], VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &clearRange);
+void Renderer::drawBackground(VkCommandBuffer commandBuffer, ComputeEffect &effect) {
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, effect.layout, 0, 1,
+                          &getCurrentFrame().drawImageDescriptors, 0, nullptr);
+  vkCmdPushConstants(commandBuffer, effect.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(effect.data), &effect.data);
+  vkCmdDispatch(commandBuffer, std::ceil(_extent.width / 16), std::ceil(_extent.height / 16), 1);
 }
 
-void Renderer::draw(VkCommandBuffer commandBuffer, ComputeEffect &effect, VkPipelineLayout layout,
-                    VkPipeline graphicsPipeline, Vector<Pointer<MeshAsset>> meshes, uint32_t imageIndex) {
+void Renderer::submitCompute(ComputeEffect &effect) {
+  FrameData &frame = getCurrentFrame();
+  VkCommandBuffer commandBuffer = frame.computeCommandBuffer;
 
-  _drawExtent.height = std::min(_extent.height, _drawImage.extent.height) * _renderScale;
-  _drawExtent.width = std::min(_extent.width, _drawImage.extent.width) * _renderScale;
+  VK_CHECK(vkResetCommandBuffer(commandBuffer, 0));
+  VkCommandBufferBeginInfo beginInfo = init::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
-  utils::transitionImage(commandBuffer, _drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+  // the last graphics use of this frame's draw image finished before its fence signaled
+  VkImageMemoryBarrier2 barrier = core::ImageStateTracker::makeBarrier(
+      frame.drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT, {},
+      {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT});
+  VkDependencyInfo depInfo = {};
+  depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  depInfo.imageMemoryBarrierCount = 1;
+  depInfo.pImageMemoryBarriers = &barrier;
+  vkCmdPipelineBarrier2(commandBuffer, &depInfo);
 
-  // transition our swapchain image to a general layout
-  utils::transitionImage(commandBuffer, _images[imageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+  {
+    GpuProfiler::Scope zone(*_gpuProfiler, commandBuffer, "background", true);
+    drawBackground(commandBuffer, effect);
+  }
 
-  // clear the swapchain image
-  VkClearColorValue clearValue = {};
-  clearValue = {{0.0f, 1.0f, 0.0f, 1.0f}};
-  VkImageSubresourceRange clearRange = init::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+  VK_CHECK(vkEndCommandBuffer(commandBuffer));
 
-  // bind the compute pipeline for drawing
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
-  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, effect.layout, 0, 1, &_drawImageDescriptors, 0,
-                          nullptr);
-  vkCmdPushConstants(commandBuffer, effect.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(effect.data), &effect.data);
-  vkCmdDispatch(commandBuffer, std::ceil(_extent.width / 16), std::ceil(_extent.height / 16), 1);
+  VkCommandBufferSubmitInfo cmdInfo = init::commandBufferSubmitInfo(commandBuffer);
+  VkSemaphoreSubmitInfo signalInfo =
+      init::semaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, frame.computeSemaphore);
+  VkSubmitInfo2 submitInfo = init::submitInfo(&cmdInfo, &signalInfo, nullptr);
+  VK_CHECK(vkQueueSubmit2(_device->computeQueue(), 1, &submitInfo, VK_NULL_HANDLE));
+
+  frame.computeSubmitted = true;
+}
+
+void Renderer::draw(VkCommandBuffer commandBuffer, ComputeEffect &effect, const RenderContext &context,
+                    uint32_t imageIndex) {
+  BISKY_PROFILE_ZONE("Renderer::draw");
+
+  FrameData &frame = getCurrentFrame();
+  _gpuProfiler->beginFrame(_currentFrame);
+  _descriptorCache->beginFrame(_currentFrame);
+  _immediateSubmit->collect();
+  updateRenderScale();
 
-  utils::transitionImage(commandBuffer, _drawImage.image, VK_IMAGE_LAYOUT_GENERAL,
-                         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-  utils::transitionImage(commandBuffer, _depthImage.image, VK_IMAGE_LAYOUT_UNDEFINED,
-                         VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+  // draw images are resized lazily, each one once its own frame comes around after a swapchain recreation
+  if (frame.drawImage.extent.width != _extent.width || frame.drawImage.extent.height != _extent.height) {
+    resizeDrawImage(frame);
+  }
+
+  _drawExtent.height = std::min(_extent.height, frame.drawImage.extent.height) * _renderScale;
+  _drawExtent.width = std::min(_extent.width, frame.drawImage.extent.width) * _renderScale;
 
-  drawGeometry(commandBuffer, layout, graphicsPipeline, meshes);
+  // the background only depends on this frame's draw image, so it overlaps with the previous frame's raster work
+  if (_device->hasAsyncCompute()) {
+    submitCompute(effect);
+  }
 
-  utils::transitionImage(commandBuffer, _drawImage.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-  utils::transitionImage(commandBuffer, _images[imageIndex], VK_IMAGE_LAYOUT_UNDEFINED,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  updateSceneData();
+  if (_lightCuller) {
+    _lightCuller->prepare(_currentFrame, frame.uniformRing, _sceneData, _drawExtent, NEAR_PLANE, FAR_PLANE);
+  }
+  _sceneDataOffset = frame.uniformRing.push(_sceneData);
 
-  // execute a copy from the draw image onto the swapchain
-  utils::copyImageToImage(commandBuffer, _drawImage.image, _images[imageIndex], _drawExtent, _extent);
+  _backgroundEffect = &effect;
+  _renderContext = &context;
+  _renderGraph->setImage("draw", frame.drawImage.image, frame.drawImage.imageView);
+  _renderGraph->setImage("output", _images[imageIndex], _imageViews[imageIndex]);
 
-  // set swapchain to color attachment optimal
-  utils::transitionImage(commandBuffer, _images[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+  GpuProfiler::Scope zone(*_gpuProfiler, commandBuffer, "frame");
+  _renderGraph->execute(commandBuffer);
+}
+
+void Renderer::updateRenderScale() {
+  // every new measurement of the frame zone is fed once, frames without timings leave the scale alone
+  const GpuProfiler::Timing *frameTiming = _gpuProfiler->timing("frame");
+  if (!frameTiming || frameTiming->count == _scaledFrames) {
+    return;
+  }
 
-  // draw imgui
-  drawImgui(commandBuffer, _imageViews[imageIndex]);
+  _scaledFrames = frameTiming->count;
+  _renderScale = _resolutionScaler.update(frameTiming->last(), _renderScale);
+}
 
-  // set swapchain to present
-  utils::transitionImage(commandBuffer, _images[imageIndex], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                         VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+void Renderer::setDepthPyramid(Pointer<DepthPyramid> depthPyramid) {
+  _depthPyramid = depthPyramid;
+  _depthPyramid->resize(_extent);
 }
 
-void Renderer::drawGeometry(VkCommandBuffer commandBuffer, VkPipelineLayout layout, VkPipeline pipeline,
-                            Vector<Pointer<MeshAsset>> meshes) {
-  VkRenderingAttachmentInfo colorAttachment =
-      init::attachmentInfo(_drawImage.imageView, nullptr, VK_IMAGE_LAYOUT_GENERAL);
+void Renderer::drawLateGeometry(VkCommandBuffer commandBuffer) {
+  if (!_gpuDriven || !_indirectDrawer || !_indirectDrawer->occlusionActive(_currentFrame)) {
+    return;
+  }
+
+  // draws on top of the early phase, neither attachment is cleared
+  VkRenderingAttachmentInfo colorAttachment = init::attachmentInfo(getCurrentFrame().drawImage.imageView, nullptr);
   VkRenderingAttachmentInfo depthAttachment =
-      init::depthAttachmentInfo(_depthImage.imageView, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+      init::depthAttachmentInfo(_renderGraph->imageView("depth"), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
   VkRenderingInfo renderInfo = init::renderingInfo(_drawExtent, &colorAttachment, &depthAttachment);
+
+  VkViewport viewport = {};
+  viewport.width = _drawExtent.width;
+  viewport.height = _drawExtent.height;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+
+  VkRect2D scissor = {};
+  scissor.extent = _drawExtent;
+
   vkCmdBeginRendering(commandBuffer, &renderInfo);
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  _indirectDrawer->drawLate(commandBuffer, _currentFrame, _sceneData.viewproj, sceneDataAddress());
+  vkCmdEndRendering(commandBuffer);
+}
 
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+void Renderer::drawGeometry(VkCommandBuffer commandBuffer, const RenderContext &context) {
+  VkRenderingAttachmentInfo colorAttachment = init::attachmentInfo(getCurrentFrame().drawImage.imageView, nullptr);
+  VkRenderingAttachmentInfo depthAttachment =
+      init::depthAttachmentInfo(_renderGraph->imageView("depth"), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+  VkRenderingInfo renderInfo = init::renderingInfo(_drawExtent, &colorAttachment, &depthAttachment);
 
   VkViewport viewport = {};
   viewport.x = 0;
@@ -520,47 +864,72 @@ void Renderer::drawGeometry(VkCommandBuffer commandBuffer, VkPipelineLayout layo
   scissor.extent.width = _drawExtent.width;
   scissor.extent.height = _drawExtent.height;
 
-  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-  VkDescriptorSet imageSet =
-      getCurrentFrame().frameDescriptors.allocate(_device->device(), _singleImageDescriptorLayout);
-  {
-    core::DescriptorWriter writer;
-    writer.writeImage(0, _errorCheckerboardImage.imageView, _defaultSamplerNearest,
-                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    writer.updateSet(_device->device(), imageSet);
+  if (_gpuDriven && _indirectDrawer) {
+    vkCmdBeginRendering(commandBuffer, &renderInfo);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    _indirectDrawer->draw(commandBuffer, _currentFrame, _sceneData.viewproj, sceneDataAddress());
+    vkCmdEndRendering(commandBuffer);
+    return;
   }
 
-  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &imageSet, 0, nullptr);
-
-  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-  glm::mat4 projection =
-      glm::perspective(glm::radians(70.0f), (float)_drawExtent.width / _drawExtent.height, 100.0f, 0.1f);
-  projection[1][1] *= -1;
-
-  // GPUBuffer::Builder builder;
-  // GPUBuffer gpuSceneDataBuffer = builder.build(_device->allocator(), sizeof(GPUSceneData),
-  //                                              VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-  // getCurrentFrame().deletionQueue.push_back([&]() { gpuSceneDataBuffer.cleanup(_device->allocator()); });
-
-  // GPUSceneData *sceneUniformData = (GPUSceneData *)gpuSceneDataBuffer.info.pMappedData;
-  // *sceneUniformData = _sceneData;
-  // VkDescriptorSet globalDescriptor =
-  //     getCurrentFrame().frameDescriptors.allocate(_device->device(), _gpuSceneDescriptorLayout);
-  //
-  // core::DescriptorWriter writer;
-  // writer.writeBuffer(0, gpuSceneDataBuffer.buffer, sizeof(gpuSceneDataBuffer), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-  // writer.updateSet(_device->device(), globalDescriptor);
-
-  GPUPushConstants pushConstants = {};
-  pushConstants.worldMatrix = projection * view;
-  pushConstants.vertexBuffer = meshes[2]->meshBuffers.vertexBufferAddress;
+  FrameData &frame = getCurrentFrame();
+
+  const Vector<uint32_t> &visible = _culler.cull(context, _sceneData.viewproj);
+  _drawList.build(context, visible, _lodSelector.select(context, visible, _cameraPosition, _projectionScale));
+  const uint32_t batchCount = _drawList.prepare(frame.uniformRing);
+
+  // small lists are not worth waking more workers for
+  constexpr uint32_t MIN_BATCHES_PER_CHUNK = 64;
+  const uint32_t chunkCount = std::clamp((batchCount + MIN_BATCHES_PER_CHUNK - 1) / MIN_BATCHES_PER_CHUNK, 1u,
+                                         static_cast<uint32_t>(frame.workers.size()));
+  const uint32_t chunkSize = (batchCount + chunkCount - 1) / chunkCount;
+
+  VkCommandBufferInheritanceRenderingInfo renderingInheritance = {};
+  renderingInheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+  renderingInheritance.colorAttachmentCount = 1;
+  renderingInheritance.pColorAttachmentFormats = &frame.drawImage.format;
+  renderingInheritance.depthAttachmentFormat = _depthFormat;
+  renderingInheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkCommandBufferInheritanceInfo inheritance = {};
+  inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritance.pNext = &renderingInheritance;
+
+  Vector<DrawList::Stats> chunkStats(chunkCount);
+  _workers->parallelFor(chunkCount, [&](uint32_t chunk) {
+    BISKY_PROFILE_ZONE("DrawList::record");
+    WorkerCommands &worker = frame.workers[chunk];
+    VK_CHECK(vkResetCommandPool(_device->device(), worker.commandPool, 0));
+
+    VkCommandBufferBeginInfo beginInfo = init::commandBufferBeginInfo(
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    beginInfo.pInheritanceInfo = &inheritance;
+    VK_CHECK(vkBeginCommandBuffer(worker.commandBuffer, &beginInfo));
+
+    // dynamic state is not inherited from the primary
+    vkCmdSetViewport(worker.commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(worker.commandBuffer, 0, 1, &scissor);
+
+    const uint32_t firstBatch = std::min(chunk * chunkSize, batchCount);
+    chunkStats[chunk] = _drawList.record(worker.commandBuffer, firstBatch, std::min(chunkSize, batchCount - firstBatch),
+                                         _bindless.set(), frame.sceneDescriptors, _sceneDataOffset);
+
+    VK_CHECK(vkEndCommandBuffer(worker.commandBuffer));
+  });
 
-  vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants), &pushConstants);
-  vkCmdBindIndexBuffer(commandBuffer, meshes[2]->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-  vkCmdDrawIndexed(commandBuffer, meshes[2]->surfaces[0].count, 1, meshes[2]->surfaces[0].startIndex, 0, 0);
+  Vector<VkCommandBuffer> secondaries(chunkCount);
+  _drawStats = {};
+  for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+    secondaries[chunk] = frame.workers[chunk].commandBuffer;
+    _drawStats += chunkStats[chunk];
+  }
+  BISKY_PROFILE_COUNTER("draws", _drawStats.draws);
+  BISKY_PROFILE_COUNTER("instances", _drawStats.instances);
 
+  renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+  vkCmdBeginRendering(commandBuffer, &renderInfo);
+  vkCmdExecuteCommands(commandBuffer, chunkCount, secondaries.data());
   vkCmdEndRendering(commandBuffer);
 }
 
@@ -575,7 +944,28 @@ void Renderer::drawImgui(VkCommandBuffer commandBuffer, VkImageView target) {
   vkCmdEndRendering(commandBuffer);
 }
 
+void Renderer::updateSceneData() {
+  _sceneData.view =
+      glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  _sceneData.proj = glm::perspective(glm::radians(70.0f), (float)_drawExtent.width / _drawExtent.height, FAR_PLANE,
+                                     NEAR_PLANE);
+  _sceneData.proj[1][1] *= -1;
+  _sceneData.viewproj = _sceneData.proj * _sceneData.view;
+  _sceneData.ambientColor = glm::vec4(0.1f);
+  // w is the intensity
+  _sceneData.sunlightColor = glm::vec4(1.0f);
+  _sceneData.sunlightDirection = glm::vec4(0.0f, 1.0f, 0.5f, 0.0f);
+
+  _cameraPosition = glm::vec3(glm::inverse(_sceneData.view)[3]);
+  _projectionScale = std::abs(_sceneData.proj[1][1]) * _drawExtent.height * 0.5f;
+}
+
 bool Renderer::acquireNextImage(uint32_t *imageIndex) {
+  if (headless()) {
+    *imageIndex = _currentFrame;
+    return true;
+  }
+
   VkResult result = vkAcquireNextImageKHR(_device->device(), _swapchain, UINT64_MAX,
                                           getCurrentFrame().swapchainSemaphore, VK_NULL_HANDLE, imageIndex);
 
@@ -590,6 +980,11 @@ bool Renderer::acquireNextImage(uint32_t *imageIndex) {
 }
 
 void Renderer::present(uint32_t imageIndex) {
+  if (headless()) {
+    _currentFrame = (_currentFrame + 1) % _frames.size();
+    return;
+  }
+
   VkPresentInfoKHR presentInfo = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
   presentInfo.waitSemaphoreCount = 1;
   presentInfo.pWaitSemaphores = &getCurrentFrame().renderSemaphore;
@@ -600,23 +995,82 @@ void Renderer::present(uint32_t imageIndex) {
 
   VkResult result = vkQueuePresentKHR(_device->queue(), &presentInfo);
 
+  // an image of the new swapchain was queued after every present of the retired ones, which are destroyed once
+  // this frame's fence signals again, a full round of frames later
+  if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+    for (std::function<void()> &deletor : _retiredSwapchains.deletors) {
+      getCurrentFrame().deletionQueue.push_back(std::move(deletor));
+    }
+    _retiredSwapchains.deletors.clear();
+  }
+
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || _framebufferResized) {
     _framebufferResized = false;
     recreate();
-    return;
   } else if (result != VK_SUCCESS) {
     throw std::runtime_error("failed to present swapchain image");
   }
 
-  _currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  // the frame was submitted either way, so the next one moves on instead of waiting for it
+  _currentFrame = (_currentFrame + 1) % _frames.size();
 }
 
-void Renderer::waitForFence() {
-  vkWaitForFences(_device->device(), 1, &getCurrentFrame().renderFence, VK_TRUE, UINT64_MAX);
+void Renderer::waitForFence() { waitForFrame(_currentFrame); }
+
+void Renderer::waitForFrame(uint32_t frame) {
+  VK_CHECK(vkWaitForFences(_device->device(), 1, &_frames[frame].renderFence, VK_TRUE, UINT64_MAX));
+  _framePacer.completed(frame);
+}
+
+void Renderer::pace() {
+  BISKY_PROFILE_ZONE("Renderer::pace");
+
+  // with n queued frames allowed, the frame submitted n frames before the next one has to be finished
+  const uint32_t frameCount = framesInFlight();
+  waitForFrame((_currentFrame + frameCount - _framePacer.queuedFrames()) % frameCount);
+}
+
+void Renderer::setPresentMode(VkPresentModeKHR presentMode) {
+  _settings.presentMode = presentMode;
+  if (!headless() && presentMode != _presentMode) {
+    _framebufferResized = true;
+  }
 }
 
 void Renderer::resetFence() { vkResetFences(_device->device(), 1, &getCurrentFrame().renderFence); }
 
+std::span<const uint8_t> Renderer::readFrame() {
+  if (!headless()) {
+    throw std::runtime_error("frames can only be read back from a headless renderer");
+  }
+
+  // present already moved on to the next frame
+  const uint32_t frame = (_currentFrame + framesInFlight() - 1) % framesInFlight();
+  waitForFrame(frame);
+
+  GPUBuffer &buffer = _readbackBuffers[frame];
+  VK_CHECK(vmaInvalidateAllocation(_device->allocator(), buffer.allocation, 0, VK_WHOLE_SIZE));
+
+  return {static_cast<const uint8_t *>(buffer.info.pMappedData), size_t(_extent.width) * _extent.height * 4};
+}
+
+void Renderer::writeFrame(const std::string &path) {
+  std::span<const uint8_t> pixels = readFrame();
+
+  if (path.ends_with(".png")) {
+    if (!stbi_write_png(path.c_str(), _extent.width, _extent.height, 4, pixels.data(), _extent.width * 4)) {
+      throw std::runtime_error("failed to write " + path);
+    }
+    return;
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("failed to open " + path);
+  }
+  file.write(reinterpret_cast<const char *>(pixels.data()), pixels.size());
+}
+
 void Renderer::recreate() {
   int width = 0, height = 0;
   glfwGetFramebufferSize(_window->window(), &width, &height);
@@ -625,13 +1079,33 @@ void Renderer::recreate() {
     glfwWaitEvents();
   }
 
-  vkDeviceWaitIdle(_device->device());
+  BISKY_PROFILE_ZONE("Renderer::recreate");
 
-  _deletionQueue.flush();
+  // frames in flight may still use the old attachments, the fence of the last submitted frame covers every earlier
+  // submission, so they are retired with it instead of waiting for the device. The fence does not cover the
+  // presents of the old swapchain, which is destroyed later by present
+  core::DeletionQueue &retired = _frames[_lastSubmittedFrame].deletionQueue;
+
+  _oldSwapchain = _swapchain;
+  Vector<VkImageView> oldImageViews = std::move(_imageViews);
 
   createSwapchain();
   createImageViews();
-  initializeDescriptors();
+
+  _retiredSwapchains.push_back([device = _device, swapchain = _oldSwapchain, imageViews = std::move(oldImageViews)]() {
+    for (VkImageView imageView : imageViews) {
+      vkDestroyImageView(device->device(), imageView, nullptr);
+    }
+    vkDestroySwapchainKHR(device->device(), swapchain, nullptr);
+  });
+  _oldSwapchain = VK_NULL_HANDLE;
+
+  // the pyramid sets reference the transient depth view the graph is about to recreate
+  _descriptorCache->evict((uint64_t)_renderGraph->imageView("depth"), &retired);
+  _renderGraph->resize(_extent, retired);
+  if (_depthPyramid) {
+    _depthPyramid->resize(_extent, &retired);
+  }
 }
 
 } // namespace rendering
@@ -0,0 +1,61 @@
+#include "rendering/resolution_scaler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bisky {
+namespace rendering {
+
+namespace {
+
+// the band between the two thresholds holds the scale steady
+constexpr float DECREASE_THRESHOLD = 1.0f;
+constexpr float INCREASE_THRESHOLD = 0.85f;
+
+// dropping resolution fixes a missed frame, raising it only trades some headroom back
+constexpr float MAX_DECREASE = 0.15f;
+constexpr float MAX_INCREASE = 0.05f;
+
+constexpr float SMOOTHING = 0.2f;
+
+} // namespace
+
+ResolutionScaler::ResolutionScaler(Settings settings, uint32_t latency) : _settings(settings), _latency(latency) {}
+
+float ResolutionScaler::update(float frameTime, float scale) {
+  // the manual scale is left alone, a pending cooldown belongs to the last automatic change
+  if (!_settings.enabled) {
+    _cooldown = 0;
+    _smoothedFrameTime = _smoothedFrameTime > 0.0f ? std::lerp(_smoothedFrameTime, frameTime, SMOOTHING) : frameTime;
+    return scale;
+  }
+
+  const float clamped = std::clamp(scale, _settings.minScale, _settings.maxScale);
+
+  // frames that were already in flight at the last change were rendered at the old scale
+  if (_cooldown > 0) {
+    _cooldown--;
+    return clamped;
+  }
+
+  _smoothedFrameTime = _smoothedFrameTime > 0.0f ? std::lerp(_smoothedFrameTime, frameTime, SMOOTHING) : frameTime;
+
+  const float target = _settings.targetFrameTime;
+  if (_smoothedFrameTime > target * DECREASE_THRESHOLD || _smoothedFrameTime < target * INCREASE_THRESHOLD) {
+    // aim for the middle of the band, the pixel count scales with the square of the scale
+    const float ratio = std::sqrt(target * (DECREASE_THRESHOLD + INCREASE_THRESHOLD) * 0.5f / _smoothedFrameTime);
+    const float next = std::clamp(scale * std::clamp(ratio, 1.0f - MAX_DECREASE, 1.0f + MAX_INCREASE),
+                                  _settings.minScale, _settings.maxScale);
+
+    if (next != scale) {
+      _cooldown = _latency;
+      _smoothedFrameTime = 0.0f;
+      return next;
+    }
+  }
+
+  return clamped;
+}
+
+} // namespace rendering
+} // namespace bisky
@@ -1,10 +1,107 @@
 #include "engine/engine.h"
 
+namespace {
+
+constexpr const char *USAGE =
+    "usage: bisky [--headless] [--frames n] [--output path] [--gpu-timings path] [--cpu-trace path]\n"
+    "             [--frames-in-flight n] [--present-mode fifo|mailbox|immediate] [--low-latency]\n"
+    "             [--target-frame-time ms]";
+
+uint32_t parseCount(const std::string &arg, const std::string &value) {
+  size_t end = 0;
+  unsigned long count = 0;
+  try {
+    count = std::stoul(value, &end);
+  } catch (const std::exception &) {
+    end = 0;
+  }
+  if (value.empty() || end != value.size() || value[0] == '-' || count > UINT32_MAX) {
+    throw std::invalid_argument("invalid value for " + arg + ": " + value);
+  }
+  return static_cast<uint32_t>(count);
+}
+
+float parseMilliseconds(const std::string &arg, const std::string &value) {
+  size_t end = 0;
+  float milliseconds = 0.0f;
+  try {
+    milliseconds = std::stof(value, &end);
+  } catch (const std::exception &) {
+    end = 0;
+  }
+  if (value.empty() || end != value.size() || milliseconds < 0.0f) {
+    throw std::invalid_argument("invalid value for " + arg + ": " + value);
+  }
+  return milliseconds;
+}
+
+VkPresentModeKHR parsePresentMode(const std::string &mode) {
+  if (mode == "fifo") {
+    return VK_PRESENT_MODE_FIFO_KHR;
+  } else if (mode == "mailbox") {
+    return VK_PRESENT_MODE_MAILBOX_KHR;
+  } else if (mode == "immediate") {
+    return VK_PRESENT_MODE_IMMEDIATE_KHR;
+  }
+  throw std::invalid_argument("invalid value for --present-mode: " + mode);
+}
+
+bisky::EngineOptions parseOptions(int argc, char *argv[]) {
+  bisky::EngineOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    // only called by the flags that take a value, so an unknown flag is never reported as missing one
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::invalid_argument("missing value for " + arg);
+      }
+      return argv[++i];
+    };
+
+    if (arg == "--headless") {
+      options.headless = true;
+    } else if (arg == "--low-latency") {
+      options.lowLatency = true;
+    } else if (arg == "--frames") {
+      // the output is read back from the last rendered frame
+      options.frames = parseCount(arg, value());
+      if (options.frames == 0) {
+        throw std::invalid_argument("invalid value for --frames: 0");
+      }
+    } else if (arg == "--output") {
+      options.output = value();
+    } else if (arg == "--gpu-timings") {
+      options.gpuTimings = value();
+    } else if (arg == "--cpu-trace") {
+      options.cpuTrace = value();
+    } else if (arg == "--frames-in-flight") {
+      options.framesInFlight = parseCount(arg, value());
+    } else if (arg == "--present-mode") {
+      options.presentMode = parsePresentMode(value());
+    } else if (arg == "--target-frame-time") {
+      options.targetFrameTime = parseMilliseconds(arg, value());
+    } else {
+      throw std::invalid_argument("unknown argument " + arg);
+    }
+  }
+  return options;
+}
+
+} // namespace
+
 int main(int argc, char *argv[]) {
+  bisky::EngineOptions options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::invalid_argument &e) {
+    std::cerr << "[error] " << e.what() << "\n" << USAGE << std::endl;
+    return 2;
+  }
+
   try {
-    bisky::Engine engine;
+    bisky::Engine engine(options);
     engine.run();
-  } catch (const std::runtime_error &e) {
+  } catch (const std::exception &e) {
     std::cerr << "[exception] " << e.what() << std::endl;
     return 1;
   }